@@ -0,0 +1,96 @@
+#pragma once
+// Benchmark helpers: timing, latency percentiles and JSON output
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../server/qos_scheduler.h"
+
+namespace filesync {
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline int64_t ElapsedNanos(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+// Result of one benchmark: per-op latencies plus totals
+struct BenchResult {
+    std::string name;
+    std::vector<int64_t> latencies_ns;
+    int64_t total_ns = 0;      // Wall time of the whole run
+    int64_t total_bytes = 0;   // Payload processed, 0 if not meaningful
+    int64_t errors = 0;
+
+    void Merge(const BenchResult& other) {
+        latencies_ns.insert(latencies_ns.end(), other.latencies_ns.begin(), other.latencies_ns.end());
+        total_bytes += other.total_bytes;
+        errors += other.errors;
+    }
+};
+
+// Nearest-rank percentile; `sorted` must be sorted ascending
+inline int64_t Percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    if (rank == 0) rank = 1;
+    return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+// Serialise results as {"name": {...}, ...}; latencies are reported in microseconds.
+inline std::string ToJson(std::vector<BenchResult> results, int indent) {
+    std::string pad(indent, ' ');
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    out << "{";
+    for (size_t i = 0; i < results.size(); ++i) {
+        BenchResult& result = results[i];
+        std::sort(result.latencies_ns.begin(), result.latencies_ns.end());
+        double seconds = result.total_ns / 1e9;
+        double ops = static_cast<double>(result.latencies_ns.size());
+
+        out << (i == 0 ? "\n" : ",\n") << pad << "  \"" << result.name << "\": {";
+        out << "\"ops\": " << result.latencies_ns.size();
+        out << ", \"errors\": " << result.errors;
+        out << ", \"seconds\": " << seconds;
+        out << ", \"ops_per_sec\": " << (seconds > 0 ? ops / seconds : 0.0);
+        if (result.total_bytes > 0) {
+            out << ", \"mb_per_sec\": " << (seconds > 0 ? result.total_bytes / seconds / (1024.0 * 1024.0) : 0.0);
+        }
+        out << ", \"p50_us\": " << Percentile(result.latencies_ns, 0.50) / 1e3;
+        out << ", \"p99_us\": " << Percentile(result.latencies_ns, 0.99) / 1e3;
+        out << ", \"p999_us\": " << Percentile(result.latencies_ns, 0.999) / 1e3;
+        out << ", \"max_us\": " << (result.latencies_ns.empty() ? 0 : result.latencies_ns.back()) / 1e3;
+        out << "}";
+    }
+    out << "\n" << pad << "}";
+    return out.str();
+}
+
+// Microbenchmarks for CRDTManager, utils::CalculateSHA256 and DBManager
+std::vector<BenchResult> RunMicroBenchmarks(int iterations, const std::string& work_dir);
+
+struct LoadOptions {
+    int clients = 8;
+    int ops_per_client = 50;
+    int file_kb = 256;
+    int port = 0; // 0 = pick a free port
+    std::string storage_engine = "auto";
+    int qos_slots = QosOptions().slots; // 0 turns server-side queuing off
+};
+
+// Starts FileSyncServer in-process and drives concurrent clients through
+// upload, download, ListFiles and CRDT workloads. The server stores blobs under
+// the current working directory, like filesync_server does.
+std::vector<BenchResult> RunLoadGenerator(const LoadOptions& options);
+
+} // namespace bench
+
+} // namespace filesync
@@ -0,0 +1,226 @@
+#include "bench_util.h"
+// End-to-end load generator against an in-process server
+#include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "filesync.grpc.pb.h"
+#include "crdt.grpc.pb.h"
+#include "../server/server.h"
+
+namespace filesync {
+
+namespace bench {
+
+namespace {
+
+const size_t kUploadChunkSize = 1024 * 1024; // Same as filesync_client
+// Background uploads for the crdt_insert_under_bulk phase; above the server's bulk threshold
+const size_t kBulkPayloadBytes = 32 * 1024 * 1024;
+const int kBulkUploaders = 4;
+
+struct BenchClient {
+    std::unique_ptr<FileSyncService::Stub> stub;
+    std::unique_ptr<CRDTService::Stub> crdt_stub;
+    std::string payload;
+    int id = 0;
+};
+
+bool Upload(BenchClient& client, const std::string& file_name, const std::string& payload) {
+    grpc::ClientContext context;
+    UploadResponse response;
+    auto writer = client.stub->UploadFile(&context, &response);
+
+    int32_t chunk_index = 0;
+    for (size_t offset = 0; offset < payload.size(); offset += kUploadChunkSize) {
+        size_t length = std::min(kUploadChunkSize, payload.size() - offset);
+        FileChunk chunk;
+        chunk.set_file_name(file_name);
+        chunk.set_chunk_index(chunk_index++);
+        chunk.set_data(payload.data() + offset, length);
+        chunk.set_is_last_chunk(offset + length == payload.size());
+        if (chunk_index == 1) chunk.set_total_size(payload.size());
+        if (!writer->Write(chunk)) break;
+    }
+    writer->WritesDone();
+    return writer->Finish().ok() && response.success();
+}
+
+bool Download(BenchClient& client, const std::string& file_name, int64_t& bytes) {
+    grpc::ClientContext context;
+    FileRequest request;
+    request.set_file_name(file_name);
+    auto reader = client.stub->DownloadFile(&context, request);
+
+    FileChunk chunk;
+    bytes = 0;
+    while (reader->Read(&chunk)) {
+        bytes += chunk.data().size();
+    }
+    return reader->Finish().ok();
+}
+
+bool List(BenchClient& client) {
+    grpc::ClientContext context;
+    ListFilesRequest request;
+    FileListResponse response;
+    return client.stub->ListFiles(&context, request, &response).ok();
+}
+
+bool CRDTInsert(BenchClient& client, const std::string& doc, int32_t clock) {
+    grpc::ClientContext context;
+    CRDTOperation op;
+    op.set_type(CRDTOperation::INSERT);
+    op.set_file_name(doc);
+    op.set_site_id("bench_" + std::to_string(client.id));
+    op.set_clock(clock);
+    // Append after our previous character
+    if (clock > 1) {
+        op.set_origin_left_site(op.site_id());
+        op.set_origin_left_clock(clock - 1);
+    }
+    op.set_content("x");
+    CRDTResponse response;
+    return client.crdt_stub->ApplyCRDTUpdate(&context, op, &response).ok() && response.success();
+}
+
+bool CRDTRead(BenchClient& client, const std::string& doc) {
+    grpc::ClientContext context;
+    CRDTStateRequest request;
+    request.set_file_name(doc);
+    CRDTStateResponse response;
+    return client.crdt_stub->GetCRDTState(&context, request, &response).ok();
+}
+
+// Run `op(client, i)` ops_per_client times on every client concurrently.
+template <typename Op>
+BenchResult RunPhase(const std::string& name, std::vector<BenchClient>& clients, int ops_per_client, Op op) {
+    std::vector<BenchResult> per_thread(clients.size());
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+    for (size_t c = 0; c < clients.size(); ++c) {
+        threads.emplace_back([&, c] {
+            BenchResult& result = per_thread[c];
+            for (int i = 0; i < ops_per_client; ++i) {
+                int64_t bytes = 0;
+                auto op_start = Clock::now();
+                bool ok = op(clients[c], i, bytes);
+                result.latencies_ns.push_back(ElapsedNanos(op_start));
+                result.total_bytes += bytes;
+                if (!ok) result.errors++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    BenchResult merged;
+    merged.name = name;
+    merged.total_ns = ElapsedNanos(start);
+    for (const auto& result : per_thread) merged.Merge(result);
+    return merged;
+}
+
+} // namespace
+
+std::vector<BenchResult> RunLoadGenerator(const LoadOptions& options) {
+    std::vector<BenchResult> results;
+
+    std::filesystem::create_directories("storage/primary");
+    std::filesystem::create_directories("storage/backup");
+
+    ServerOptions server_options;
+    server_options.storage_engine = options.storage_engine;
+    server_options.qos.slots = options.qos_slots;
+    FileSyncServer server("127.0.0.1:" + std::to_string(options.port), "bench_load.db", server_options);
+    if (!server.Start()) {
+        std::cerr << "Load generator: failed to start in-process server" << std::endl;
+        return results;
+    }
+    std::string target = "127.0.0.1:" + std::to_string(server.port());
+
+    std::vector<BenchClient> clients(options.clients);
+    std::mt19937_64 rng(7);
+    for (int c = 0; c < options.clients; ++c) {
+        // A separate channel per client so each gets its own HTTP/2 connection
+        grpc::ChannelArguments args;
+        args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        args.SetMaxReceiveMessageSize(-1);
+        auto channel = grpc::CreateCustomChannel(target, grpc::InsecureChannelCredentials(), args);
+        clients[c].stub = FileSyncService::NewStub(channel);
+        clients[c].crdt_stub = CRDTService::NewStub(channel);
+        clients[c].id = c;
+        clients[c].payload.resize(static_cast<size_t>(options.file_kb) * 1024);
+        for (auto& byte : clients[c].payload) byte = static_cast<char>(rng());
+    }
+
+    auto file_name = [](const BenchClient& client, int i) {
+        return "bench_" + std::to_string(client.id) + "_" + std::to_string(i) + ".bin";
+    };
+
+    results.push_back(RunPhase("upload", clients, options.ops_per_client, [&](BenchClient& client, int i, int64_t& bytes) {
+        bytes = client.payload.size();
+        return Upload(client, file_name(client, i), client.payload);
+    }));
+
+    results.push_back(RunPhase("download", clients, options.ops_per_client, [&](BenchClient& client, int i, int64_t& bytes) {
+        return Download(client, file_name(client, i), bytes);
+    }));
+
+    // Every client fetching the same file, as after a popular publish
+    results.push_back(RunPhase("download_hot", clients, options.ops_per_client, [&](BenchClient& client, int /*i*/, int64_t& bytes) {
+        return Download(client, file_name(clients[0], 0), bytes);
+    }));
+
+    results.push_back(RunPhase("list_files", clients, options.ops_per_client, [&](BenchClient& client, int /*i*/, int64_t& /*bytes*/) {
+        return List(client);
+    }));
+
+    int crdt_ops = options.ops_per_client * 10;
+    results.push_back(RunPhase("crdt_insert", clients, crdt_ops, [&](BenchClient& client, int i, int64_t& /*bytes*/) {
+        return CRDTInsert(client, "bench_doc_" + std::to_string(client.id % 4), i + 1);
+    }));
+
+    results.push_back(RunPhase("crdt_get_state", clients, crdt_ops, [&](BenchClient& client, int /*i*/, int64_t& /*bytes*/) {
+        return CRDTRead(client, "bench_doc_" + std::to_string(client.id % 4));
+    }));
+
+    // Interactive latency while large uploads saturate the server; compare with crdt_insert
+    std::atomic<bool> stop_bulk{false};
+    std::vector<BenchResult> bulk_results(kBulkUploaders);
+    std::vector<std::thread> bulk_threads;
+    std::string bulk_payload(kBulkPayloadBytes, '\0');
+    for (auto& byte : bulk_payload) byte = static_cast<char>(rng());
+    auto bulk_start = Clock::now();
+    for (int b = 0; b < kBulkUploaders; ++b) {
+        bulk_threads.emplace_back([&, b] {
+            BenchClient& client = clients[b % clients.size()];
+            for (int i = 0; !stop_bulk.load(); ++i) {
+                auto op_start = Clock::now();
+                bool ok = Upload(client, "bench_bulk_" + std::to_string(b) + "_" + std::to_string(i) + ".bin", bulk_payload);
+                bulk_results[b].latencies_ns.push_back(ElapsedNanos(op_start));
+                bulk_results[b].total_bytes += bulk_payload.size();
+                if (!ok) bulk_results[b].errors++;
+            }
+        });
+    }
+    results.push_back(RunPhase("crdt_insert_under_bulk", clients, crdt_ops, [&](BenchClient& client, int i, int64_t& /*bytes*/) {
+        return CRDTInsert(client, "bench_doc_" + std::to_string(client.id % 4), crdt_ops + i + 1);
+    }));
+    stop_bulk = true;
+    for (auto& thread : bulk_threads) thread.join();
+    BenchResult bulk;
+    bulk.name = "bulk_upload_background";
+    bulk.total_ns = ElapsedNanos(bulk_start);
+    for (const auto& result : bulk_results) bulk.Merge(result);
+    results.push_back(bulk);
+
+    server.Shutdown();
+    return results;
+}
+
+} // namespace bench
+
+} // namespace filesync
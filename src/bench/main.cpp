@@ -0,0 +1,106 @@
+#include "bench_util.h"
+// Benchmark entry point
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <stdexcept>
+#include "../common/logger.h"
+
+namespace {
+
+void PrintUsage() {
+    std::cerr << "Usage: ./filesync_bench [--micro-only|--load-only] [--iterations=<n>] [--clients=<n>]"
+              << " [--ops=<n>] [--file-kb=<n>] [--port=<n>] [--storage-engine=<kind>] [--qos-slots=<n>] [--out=<path>]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool run_micro = true;
+    bool run_load = true;
+    int micro_iterations = 2000;
+    std::string out_path;
+    filesync::bench::LoadOptions load;
+
+    // Flags: --micro-only --load-only --iterations=<n> --clients=<n> --ops=<n>
+    //        --file-kb=<n> --port=<n> --storage-engine=<kind> --qos-slots=<n> --out=<path>
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        try {
+            if (arg == "--micro-only") {
+                run_load = false;
+            } else if (arg == "--load-only") {
+                run_micro = false;
+            } else if (arg.rfind("--iterations=", 0) == 0) {
+                micro_iterations = std::stoi(arg.substr(13));
+            } else if (arg.rfind("--clients=", 0) == 0) {
+                load.clients = std::stoi(arg.substr(10));
+            } else if (arg.rfind("--ops=", 0) == 0) {
+                load.ops_per_client = std::stoi(arg.substr(6));
+            } else if (arg.rfind("--file-kb=", 0) == 0) {
+                load.file_kb = std::stoi(arg.substr(10));
+            } else if (arg.rfind("--port=", 0) == 0) {
+                load.port = std::stoi(arg.substr(7));
+            } else if (arg.rfind("--storage-engine=", 0) == 0) {
+                load.storage_engine = arg.substr(17);
+            } else if (arg.rfind("--qos-slots=", 0) == 0) {
+                load.qos_slots = std::stoi(arg.substr(12));
+            } else if (arg.rfind("--out=", 0) == 0) {
+                out_path = arg.substr(6);
+            } else {
+                PrintUsage();
+                return 1;
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Invalid value: " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    // The load generator spreads its bulk uploaders over the clients
+    if (micro_iterations < 1 || load.clients < 1 || load.ops_per_client < 1 || load.file_kb < 0 || load.qos_slots < 0) {
+        std::cerr << "--iterations, --clients and --ops must be at least 1; --file-kb and --qos-slots must not be negative" << std::endl;
+        return 1;
+    }
+    if (!out_path.empty()) {
+        out_path = std::filesystem::absolute(out_path).string();
+    }
+
+    // Everything the benchmarks write (DBs, storage/) goes into a scratch directory
+    auto original_dir = std::filesystem::current_path();
+    auto work_dir = std::filesystem::temp_directory_path() / ("filesync_bench_" + std::to_string(getpid()));
+    std::filesystem::create_directories(work_dir);
+    std::filesystem::current_path(work_dir);
+
+    // Only warnings and errors (stderr) from the in-process server; stdout carries the JSON report
+    filesync::Logger::Instance().SetLevel(filesync::LogLevel::Warning);
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"config\": {\"iterations\": " << micro_iterations << ", \"clients\": " << load.clients
+         << ", \"ops_per_client\": " << load.ops_per_client << ", \"file_kb\": " << load.file_kb
+         << ", \"storage_engine\": \"" << load.storage_engine << "\", \"qos_slots\": " << load.qos_slots << "}";
+    if (run_micro) {
+        std::cerr << "Running microbenchmarks..." << std::endl;
+        json << ",\n  \"micro\": " << filesync::bench::ToJson(filesync::bench::RunMicroBenchmarks(micro_iterations, work_dir.string()), 2);
+    }
+    if (run_load) {
+        std::cerr << "Running load generator..." << std::endl;
+        json << ",\n  \"load\": " << filesync::bench::ToJson(filesync::bench::RunLoadGenerator(load), 2);
+    }
+    json << "\n}\n";
+
+    std::filesystem::current_path(original_dir);
+    std::filesystem::remove_all(work_dir);
+
+    if (out_path.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(out_path);
+        out << json.str();
+        std::cerr << "Wrote " << out_path << std::endl;
+    }
+    return 0;
+}
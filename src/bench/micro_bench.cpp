@@ -0,0 +1,208 @@
+#include "bench_util.h"
+// Microbenchmarks for the CRDT engine, hashing and the metadata DB
+#include <fstream>
+#include <random>
+#include "../common/crdt_manager.h"
+#include "../common/utils.h"
+#include "../db/db_manager.h"
+
+namespace filesync {
+
+namespace bench {
+
+namespace {
+
+// Keep the compiler from discarding results
+volatile size_t g_sink = 0;
+
+BenchResult BenchCRDTInsert(int n) {
+    BenchResult result;
+    result.name = "crdt_local_insert";
+    CRDTManager crdt("bench");
+    auto start = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        auto op_start = Clock::now();
+        crdt.LocalInsert("doc", i, 'a' + (i % 26));
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    return result;
+}
+
+BenchResult BenchCRDTRemoteInsert(int n) {
+    BenchResult result;
+    result.name = "crdt_apply_insert";
+    CRDTManager crdt("server");
+    CharID prev = {"", 0};
+    auto start = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        CharID id = {"remote", i + 1};
+        auto op_start = Clock::now();
+        crdt.ApplyInsert("doc", 'a' + (i % 26), id, prev);
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+        prev = id;
+    }
+    result.total_ns = ElapsedNanos(start);
+    return result;
+}
+
+BenchResult BenchCRDTDelete(int n) {
+    BenchResult result;
+    result.name = "crdt_apply_delete";
+    CRDTManager crdt("bench");
+    std::vector<CharID> ids;
+    for (int i = 0; i < n; ++i) {
+        ids.push_back(crdt.LocalInsert("doc", i, 'x').id);
+    }
+    auto start = Clock::now();
+    for (const auto& id : ids) {
+        auto op_start = Clock::now();
+        crdt.ApplyDelete("doc", id);
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    return result;
+}
+
+BenchResult BenchCRDTGetText(int doc_size, int reads) {
+    BenchResult result;
+    result.name = "crdt_get_text";
+    CRDTManager crdt("bench");
+    for (int i = 0; i < doc_size; ++i) {
+        crdt.LocalInsert("doc", i, 'a' + (i % 26));
+    }
+    auto start = Clock::now();
+    for (int i = 0; i < reads; ++i) {
+        auto op_start = Clock::now();
+        g_sink += crdt.GetText("doc").size();
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    result.total_bytes = static_cast<int64_t>(doc_size) * reads;
+    return result;
+}
+
+BenchResult BenchCRDTImport(size_t doc_size, int runs) {
+    BenchResult result;
+    result.name = "crdt_import";
+    std::string text(doc_size, 'x');
+    for (size_t i = 0; i < doc_size; ++i) text[i] = 'a' + (i % 26);
+    auto start = Clock::now();
+    for (int i = 0; i < runs; ++i) {
+        CRDTManager crdt("bench");
+        auto op_start = Clock::now();
+        CharID first_id;
+        if (!crdt.ReserveIds(text.size(), first_id) || !crdt.Import("doc", text, first_id)) result.errors++;
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    result.total_bytes = static_cast<int64_t>(doc_size) * runs;
+    return result;
+}
+
+BenchResult BenchSHA256(const std::string& work_dir, int64_t file_bytes, int runs) {
+    BenchResult result;
+    result.name = "sha256_file";
+    std::string path = work_dir + "/sha256_input.bin";
+    {
+        std::mt19937_64 rng(42);
+        std::ofstream out(path, std::ios::binary);
+        std::vector<uint64_t> block(8192);
+        for (int64_t written = 0; written < file_bytes; written += block.size() * sizeof(uint64_t)) {
+            for (auto& word : block) word = rng();
+            out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(uint64_t));
+        }
+    }
+    int64_t actual_size = utils::GetFileSize(path);
+    auto start = Clock::now();
+    for (int i = 0; i < runs; ++i) {
+        auto op_start = Clock::now();
+        g_sink += utils::CalculateSHA256(path).size();
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    result.total_bytes = actual_size * runs;
+    return result;
+}
+
+BenchResult BenchDBAddFile(const std::string& work_dir, int n) {
+    BenchResult result;
+    result.name = "db_add_file";
+    std::string path = work_dir + "/bench_micro.db";
+    DBManager db(path);
+    if (!db.Init()) {
+        result.errors = n;
+        return result;
+    }
+    std::string hash(64, 'f');
+    auto start = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        auto op_start = Clock::now();
+        if (!db.AddFile("file_" + std::to_string(i), hash, 2048, i)) result.errors++;
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    return result;
+}
+
+BenchResult BenchDBAddChunk(const std::string& work_dir, int n) {
+    BenchResult result;
+    result.name = "db_add_chunk";
+    std::string path = work_dir + "/bench_micro.db";
+    DBManager db(path);
+    if (!db.Init()) {
+        result.errors = n;
+        return result;
+    }
+    auto start = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        auto op_start = Clock::now();
+        if (!db.AddChunk("chunked_file", i, "primary")) result.errors++;
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    return result;
+}
+
+BenchResult BenchDBGetFile(const std::string& work_dir, int n, int rows) {
+    BenchResult result;
+    result.name = "db_get_file";
+    std::string path = work_dir + "/bench_micro.db";
+    DBManager db(path);
+    if (!db.Init()) {
+        result.errors = n;
+        return result;
+    }
+    // Looks up the `rows` rows written by db_add_file
+    std::string hash;
+    int64_t size, timestamp;
+    auto start = Clock::now();
+    for (int i = 0; i < n; ++i) {
+        auto op_start = Clock::now();
+        if (!db.GetFile("file_" + std::to_string(i % rows), hash, size, timestamp)) result.errors++;
+        result.latencies_ns.push_back(ElapsedNanos(op_start));
+    }
+    result.total_ns = ElapsedNanos(start);
+    return result;
+}
+
+} // namespace
+
+std::vector<BenchResult> RunMicroBenchmarks(int iterations, const std::string& work_dir) {
+    std::vector<BenchResult> results;
+    results.push_back(BenchCRDTInsert(iterations));
+    results.push_back(BenchCRDTRemoteInsert(iterations));
+    results.push_back(BenchCRDTDelete(iterations));
+    results.push_back(BenchCRDTGetText(iterations, 1000));
+    results.push_back(BenchCRDTImport(1024 * 1024, 5));
+    results.push_back(BenchSHA256(work_dir, 16 * 1024 * 1024, 10));
+    int db_rows = std::min(iterations, 2000);
+    results.push_back(BenchDBAddFile(work_dir, db_rows));
+    results.push_back(BenchDBAddChunk(work_dir, db_rows));
+    results.push_back(BenchDBGetFile(work_dir, iterations, db_rows));
+    return results;
+}
+
+} // namespace bench
+
+} // namespace filesync
@@ -1,14 +1,44 @@
 #include "client.h"
 // Client implementation logic
 #include "../common/utils.h"
+#include "transfer_pipeline.h"
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <filesystem>
 #include <unordered_map>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace filesync {
 
+namespace {
+
+// Ranges are aligned to the server's chunk size so each one maps onto whole cache chunks
+constexpr int64_t kRangeAlignment = 1024 * 1024;
+// Files at least this large are fetched over several streams during Sync
+constexpr int64_t kParallelDownloadThreshold = 8 * kRangeAlignment;
+constexpr int kSyncDownloadStreams = 4;
+constexpr int kRangeAttempts = 3;
+// Sync sends files up to this size through the batch RPCs
+constexpr int64_t kBatchFileThreshold = 256 * 1024;
+// Server-side batch limits
+constexpr int64_t kMaxBatchFileSize = 1024 * 1024;
+constexpr size_t kMaxBatchFiles = 4096;
+constexpr size_t kBatchFrameBytes = 1024 * 1024;
+// Buffers in flight between the disk thread and the stream for a single-stream transfer
+constexpr size_t kPipelineBuffers = 4;
+// Upload chunk size before any throughput has been measured
+constexpr size_t kInitialChunkSize = 1024 * 1024;
+
+} // namespace
+
 FileSyncClient::FileSyncClient(std::shared_ptr<grpc::Channel> channel, std::string client_id)
     : stub_(FileSyncService::NewStub(channel)), crdt_stub_(CRDTService::NewStub(channel)), crdt_manager_(client_id) {}
 
@@ -38,9 +68,11 @@ void FileSyncClient::EditFile(const std::string& file_name, int index, char cont
     }
 }
 
-void FileSyncClient::GetCRDTState(const std::string& file_name) {
+void FileSyncClient::GetCRDTState(const std::string& file_name, int64_t offset, int64_t length) {
     CRDTStateRequest request;
     request.set_file_name(file_name);
+    request.set_offset(offset);
+    request.set_length(length);
     
     CRDTStateResponse response;
     grpc::ClientContext context;
@@ -48,40 +80,129 @@ void FileSyncClient::GetCRDTState(const std::string& file_name) {
     grpc::Status status = crdt_stub_->GetCRDTState(&context, request, &response);
     
     if (status.ok()) {
-        std::cout << "Current File Content: " << response.content() << std::endl;
+        if (offset == 0 && length == 0) {
+            std::cout << "Current File Content: " << response.content() << std::endl;
+        } else {
+            std::cout << "Current File Content [" << offset << ", " << offset + static_cast<int64_t>(response.content().size())
+                      << ") of " << response.total_length() << ": " << response.content() << std::endl;
+        }
     } else {
         std::cerr << "Failed to get CRDT state: " << status.error_message() << std::endl;
     }
 }
 
+bool FileSyncClient::OpenCRDTDocument(const std::string& file_name) {
+    CRDTImportRequest request;
+    request.set_file_name(file_name);
+    CRDTImportResponse response;
+    grpc::ClientContext context;
+    AttachTrace(context);
+    grpc::Status status = crdt_stub_->ImportFile(&context, request, &response);
+    if (!status.ok()) {
+        std::cerr << "Failed to open document: " << status.error_message() << std::endl;
+        return false;
+    }
+    CharID first_id = {response.site_id(), response.first_clock()};
+    CRDTManager::ImportedRun local;
+    if (crdt_manager_.GetImportedRun(file_name, local) && local.first_id == first_id && local.source == response.file_hash()) {
+        std::cout << file_name << " is already open (" << local.length << " characters)" << std::endl;
+        return true;
+    }
+
+    // The server imported the file as one run of IDs; rebuild the same run locally
+    // from the exact version it used
+    FileRequest download;
+    download.set_file_name(file_name);
+    download.set_expected_hash(response.file_hash());
+    grpc::ClientContext download_context;
+    std::unique_ptr<grpc::ClientReader<FileChunk>> reader(stub_->DownloadFile(&download_context, download));
+    std::string text;
+    FileChunk chunk;
+    while (reader->Read(&chunk)) {
+        text += chunk.data();
+    }
+    status = reader->Finish();
+    if (!status.ok() || static_cast<int64_t>(text.size()) != response.length()) {
+        std::cerr << "Failed to fetch document content: " << status.error_message() << std::endl;
+        return false;
+    }
+
+    if (!crdt_manager_.Import(file_name, text, first_id, response.file_hash())) {
+        std::cerr << "Document already open locally: " << file_name << std::endl;
+        return false;
+    }
+    std::cout << "Opened " << file_name << " for editing (" << text.size() << " characters)" << std::endl;
+    return true;
+}
+
+bool FileSyncClient::SaveCRDTDocument(const std::string& file_name) {
+    CRDTExportRequest request;
+    request.set_file_name(file_name);
+    CRDTExportResponse response;
+    grpc::ClientContext context;
+    AttachTrace(context);
+    grpc::Status status = crdt_stub_->ExportFile(&context, request, &response);
+    if (!status.ok()) {
+        std::cerr << "Failed to save document: " << status.error_message() << std::endl;
+        return false;
+    }
+    std::cout << "Saved " << file_name << " Size: " << response.file_size() << " Hash: " << response.file_hash() << std::endl;
+    return true;
+}
+
 void FileSyncClient::Sync() {
     std::cout << "Starting Sync..." << std::endl;
+
+    if (!sync_trace_path_.empty()) {
+        trace_.trace_id = tracing::Tracer::Global().NewTraceId();
+    }
+    tracing::Span sync_span(trace_, "sync");
     
     // 1. Get Server File List
     ListFilesRequest request;
     FileListResponse response;
     grpc::ClientContext context;
+    AttachTrace(context);
     
+    tracing::Span list_span(trace_, "sync.list_files");
     grpc::Status status = stub_->ListFiles(&context, request, &response);
+    list_span.End();
     if (!status.ok()) {
         std::cerr << "Sync failed: Could not list server files (" << status.error_message() << ")" << std::endl;
         return;
     }
     
     std::unordered_map<std::string, std::string> server_files;
+    std::unordered_map<std::string, int64_t> server_sizes;
     for (const auto& file : response.files()) {
         server_files[file.file_name()] = file.file_hash();
+        server_sizes[file.file_name()] = file.file_size();
     }
+
+    // Small files are collected and transferred through the batch RPCs
+    std::vector<std::string> batch_downloads, batch_uploads;
+    auto download = [&](const std::string& name) {
+        if (server_sizes[name] <= kBatchFileThreshold) {
+            batch_downloads.push_back(name);
+        } else if (server_sizes[name] >= kParallelDownloadThreshold) {
+            DownloadFileParallel(name, name, kSyncDownloadStreams);
+        } else {
+            DownloadFile(name, name);
+        }
+    };
     
     // 2. Scan Local Directory
     std::unordered_map<std::string, std::string> local_files;
+    std::unordered_map<std::string, int64_t> local_sizes;
     for (const auto& entry : std::filesystem::directory_iterator(".")) {
         if (entry.is_regular_file()) {
             std::string name = entry.path().filename().string();
             // Skip hidden files, build dir, and storage dir
             if (name[0] == '.' || name == "build" || name == "storage" || name == "filesync.db") continue;
             
+            tracing::Span hash_span(trace_, "sync.scan_hash", name);
             local_files[name] = utils::CalculateSHA256(name);
+            local_sizes[name] = static_cast<int64_t>(entry.file_size());
         }
     }
     
@@ -89,10 +210,10 @@ void FileSyncClient::Sync() {
     for (const auto& [name, hash] : server_files) {
         if (local_files.find(name) == local_files.end()) {
             std::cout << "[+] Downloading missing file: " << name << std::endl;
-            DownloadFile(name, name);
+            download(name);
         } else if (local_files[name] != hash) {
             std::cout << "[*] Updating changed file: " << name << std::endl;
-            DownloadFile(name, name);
+            download(name);
         }
     }
     
@@ -100,11 +221,128 @@ void FileSyncClient::Sync() {
     for (const auto& [name, hash] : local_files) {
         if (server_files.find(name) == server_files.end()) {
             std::cout << "[+] Uploading new file: " << name << std::endl;
-            UploadFile(name);
+            if (local_sizes[name] <= kBatchFileThreshold) {
+                batch_uploads.push_back(name);
+            } else {
+                UploadFile(name);
+            }
         }
     }
+
+    for (size_t i = 0; i < batch_downloads.size(); i += kMaxBatchFiles) {
+        auto end = batch_downloads.begin() + std::min(batch_downloads.size(), i + kMaxBatchFiles);
+        DownloadFileBatch(std::vector<std::string>(batch_downloads.begin() + i, end));
+    }
+    for (size_t i = 0; i < batch_uploads.size(); i += kMaxBatchFiles) {
+        auto end = batch_uploads.begin() + std::min(batch_uploads.size(), i + kMaxBatchFiles);
+        UploadFileBatch(std::vector<std::string>(batch_uploads.begin() + i, end));
+    }
     
     std::cout << "Sync Complete." << std::endl;
+
+    if (trace_.active()) {
+        sync_span.End();
+        std::ofstream trace_file(sync_trace_path_);
+        trace_file << tracing::Tracer::Global().DumpChromeJson(true);
+        std::cout << "Client trace written to " << sync_trace_path_ << " (trace id "
+                  << std::hex << trace_.trace_id << std::dec << ")" << std::endl;
+        trace_ = tracing::TraceContext();
+    }
+}
+
+void FileSyncClient::SetSyncTraceOutput(const std::string& trace_path) {
+    sync_trace_path_ = trace_path;
+}
+
+void FileSyncClient::AttachTrace(grpc::ClientContext& context) const {
+    if (!trace_.active()) return;
+    std::ostringstream id;
+    id << std::hex << trace_.trace_id;
+    context.AddMetadata(tracing::kTraceMetadataKey, id.str());
+}
+
+bool FileSyncClient::ServerTrace(const std::string& mode, const std::string& output_path) {
+    TraceRequest request;
+    if (mode == "on") {
+        request.set_mode(TraceRequest::ENABLE);
+    } else if (mode == "off") {
+        request.set_mode(TraceRequest::DISABLE);
+    } else if (mode == "dump") {
+        request.set_clear(true);
+    } else {
+        std::cerr << "Unknown trace mode: " << mode << " (expected on, off or dump)" << std::endl;
+        return false;
+    }
+
+    TraceResponse response;
+    grpc::ClientContext context;
+    grpc::Status status = stub_->GetTrace(&context, request, &response);
+    if (!status.ok()) {
+        std::cerr << "Trace request failed: " << status.error_message() << std::endl;
+        return false;
+    }
+
+    if (mode == "dump") {
+        std::ofstream out(output_path);
+        if (!out.is_open()) {
+            std::cerr << "Failed to open " << output_path << std::endl;
+            return false;
+        }
+        out << response.trace_json();
+        std::cout << "Server trace written to " << output_path << " (open in chrome://tracing or ui.perfetto.dev)" << std::endl;
+    } else {
+        std::cout << "Server tracing " << (response.enabled() ? "enabled" : "disabled") << std::endl;
+    }
+    return true;
+}
+
+void FileSyncClient::PrintServerStats() {
+    StatsRequest request;
+    StatsResponse response;
+    grpc::ClientContext context;
+
+    grpc::Status status = stub_->GetStats(&context, request, &response);
+    if (!status.ok()) {
+        std::cerr << "Failed to get server stats: " << status.error_message() << std::endl;
+        return;
+    }
+
+    std::cout << "Chunk cache:" << std::endl;
+    std::cout << "  hits: " << response.cache_hits() << " misses: " << response.cache_misses()
+              << " (coalesced: " << response.cache_coalesced_misses() << ")" << std::endl;
+    std::cout << "  hit ratio: " << response.cache_hit_ratio() << std::endl;
+    std::cout << "  bytes saved: " << response.cache_bytes_saved() << std::endl;
+    std::cout << "  used: " << response.cache_bytes_used() << " / " << response.cache_capacity_bytes()
+              << " bytes, evictions: " << response.cache_evictions() << std::endl;
+
+    std::cout << "QoS (slots: " << response.qos_slots() << ", client rate: ";
+    if (response.qos_client_rate_bytes() > 0) {
+        std::cout << response.qos_client_rate_bytes() << " B/s";
+    } else {
+        std::cout << "unlimited";
+    }
+    std::cout << "):" << std::endl;
+    for (const auto& qos : response.qos()) {
+        std::string weight = qos.weight() > 0 ? "weight " + std::to_string(qos.weight()) : "not queued";
+        std::cout << "  " << qos.name() << " (" << weight << "): admitted: " << qos.admitted()
+                  << " bytes: " << qos.bytes() << " active: " << qos.active() << " queued: " << qos.queued() << std::endl;
+        std::cout << "    queue wait p50/p99: " << qos.queue_wait_p50_us() << "/" << qos.queue_wait_p99_us()
+                  << " us, throttled: " << qos.throttled() << " (" << qos.throttle_wait_us() << " us)" << std::endl;
+    }
+}
+
+void FileSyncClient::PrintServerMetrics() {
+    StatsRequest request;
+    StatsResponse response;
+    grpc::ClientContext context;
+
+    grpc::Status status = stub_->GetStats(&context, request, &response);
+    if (!status.ok()) {
+        std::cerr << "Failed to get server metrics: " << status.error_message() << std::endl;
+        return;
+    }
+    // Prometheus text format, e.g. for the node_exporter textfile collector
+    std::cout << response.prometheus_text();
 }
 
 bool FileSyncClient::UploadFile(const std::string& file_path) {
@@ -117,33 +355,73 @@ bool FileSyncClient::UploadFile(const std::string& file_path) {
     // Get file name from path
     std::string file_name = file_path.substr(file_path.find_last_of("/\\") + 1);
 
+    tracing::Span upload_span(trace_, "sync.upload", file_name);
     grpc::ClientContext context;
+    AttachTrace(context);
     UploadResponse response;
     std::unique_ptr<grpc::ClientWriter<FileChunk>> writer(stub_->UploadFile(&context, &response));
 
-    const size_t kChunkSize = 1024 * 1024; // 1MB
-    std::vector<char> buffer(kChunkSize);
-    int32_t chunk_index = 0;
     int64_t total_size = utils::GetFileSize(file_path);
 
-    while (infile.read(buffer.data(), kChunkSize) || infile.gcount() > 0) {
-        FileChunk chunk;
-        chunk.set_file_name(file_name);
-        chunk.set_chunk_index(chunk_index++);
-        chunk.set_data(buffer.data(), infile.gcount());
-        chunk.set_is_last_chunk(infile.eof());
-        if (chunk_index == 1) {
-            chunk.set_total_size(total_size);
-        }
-        
-        if (!writer->Write(chunk)) {
+    // Disk thread reads ahead into the ring while this thread sends
+    BufferRing ring(kPipelineBuffers);
+    ChunkSizer sizer(kInitialChunkSize);
+    std::atomic<bool> read_failed{false};
+    std::thread disk([&]() {
+        int64_t remaining = total_size;
+        do {
+            BufferRing::Buffer* buffer = ring.AcquireEmpty();
+            if (!buffer) return;
+            buffer->data.resize(static_cast<size_t>(std::min<int64_t>(remaining, sizer.size())));
+            if (!infile.read(&buffer->data[0], buffer->data.size())) {
+                read_failed = true;
+                ring.Close();
+                return;
+            }
+            remaining -= buffer->data.size();
+            buffer->last = remaining <= 0;
+            ring.PushFull(buffer);
+        } while (remaining > 0);
+    });
+
+    FileChunk chunk;
+    chunk.set_file_name(file_name);
+    chunk.set_total_size(total_size);
+    bool sent_all = false;
+    for (int32_t chunk_index = 0;; ++chunk_index) {
+        BufferRing::Buffer* buffer = ring.PopFull();
+        if (!buffer) break;
+        chunk.set_chunk_index(chunk_index);
+        chunk.set_is_last_chunk(buffer->last);
+        chunk.mutable_data()->swap(buffer->data);
+
+        auto send_start = std::chrono::steady_clock::now();
+        bool sent = writer->Write(chunk);
+        sizer.Record(chunk.data().size(), std::chrono::steady_clock::now() - send_start);
+
+        chunk.mutable_data()->swap(buffer->data);
+        chunk.clear_total_size(); // Only the first chunk carries it
+        bool last = buffer->last;
+        ring.Recycle(buffer);
+        if (!sent) {
             std::cerr << "Broken stream." << std::endl;
-            return false;
+            break;
+        }
+        if (last) {
+            sent_all = true;
+            break;
         }
-        
-        if (infile.eof()) break;
     }
-    
+    ring.Close();
+    disk.join();
+
+    if (!sent_all) {
+        if (read_failed) std::cerr << "Failed to read file: " << file_path << std::endl;
+        context.TryCancel();
+        writer->Finish();
+        return false;
+    }
+
     writer->WritesDone();
     grpc::Status status = writer->Finish();
     
@@ -160,23 +438,57 @@ bool FileSyncClient::DownloadFile(const std::string& file_name, const std::strin
     FileRequest request;
     request.set_file_name(file_name);
 
+    tracing::Span download_span(trace_, "sync.download", file_name);
     grpc::ClientContext context;
+    AttachTrace(context);
     std::unique_ptr<grpc::ClientReader<FileChunk>> reader(stub_->DownloadFile(&context, request));
 
     std::ofstream outfile(dest_path, std::ios::binary);
     if (!outfile.is_open()) {
         std::cerr << "Failed to open destination file: " << dest_path << std::endl;
+        context.TryCancel();
+        reader->Finish();
         return false;
     }
 
+    // Disk thread drains the ring while this thread keeps reading the stream
+    BufferRing ring(kPipelineBuffers);
+    std::atomic<bool> write_failed{false};
+    std::thread disk([&]() {
+        while (BufferRing::Buffer* buffer = ring.PopFull()) {
+            outfile.write(buffer->data.data(), buffer->data.size());
+            bool last = buffer->last;
+            ring.Recycle(buffer);
+            if (!outfile) {
+                write_failed = true;
+                ring.Close();
+                return;
+            }
+            if (last) return;
+        }
+    });
+
     FileChunk chunk;
-    while (reader->Read(&chunk)) {
-        outfile.write(chunk.data().c_str(), chunk.data().length());
-        std::cout << "Received chunk " << chunk.chunk_index() << std::endl;
+    while (BufferRing::Buffer* buffer = ring.AcquireEmpty()) {
+        if (!reader->Read(&chunk)) {
+            buffer->data.clear();
+            buffer->last = true;
+            ring.PushFull(buffer);
+            break;
+        }
+        buffer->data.swap(*chunk.mutable_data());
+        ring.PushFull(buffer);
     }
+    disk.join();
+    ring.Close();
 
+    if (write_failed) {
+        std::cerr << "Failed to write destination file: " << dest_path << std::endl;
+        context.TryCancel();
+    }
     grpc::Status status = reader->Finish();
-    if (status.ok()) {
+    outfile.close();
+    if (status.ok() && !write_failed && outfile) {
         std::cout << "Download successful." << std::endl;
         return true;
     } else {
@@ -185,4 +497,261 @@ bool FileSyncClient::DownloadFile(const std::string& file_name, const std::strin
     }
 }
 
+int FileSyncClient::UploadFileBatch(const std::vector<std::string>& file_paths) {
+    tracing::Span batch_span(trace_, "sync.batch_upload");
+    grpc::ClientContext context;
+    AttachTrace(context);
+    BatchUploadResponse response;
+    std::unique_ptr<grpc::ClientWriter<BatchFileFrame>> writer(stub_->BatchUpload(&context, &response));
+
+    BatchFileFrame frame;
+    size_t frame_bytes = 0;
+    int skipped = 0;
+    bool stream_ok = true;
+    for (const auto& file_path : file_paths) {
+        std::ifstream infile(file_path, std::ios::binary | std::ios::ate);
+        if (!infile.is_open()) {
+            std::cerr << "Failed to open file: " << file_path << std::endl;
+            ++skipped;
+            continue;
+        }
+        int64_t size = infile.tellg();
+        if (size > kMaxBatchFileSize) {
+            std::cerr << "Skipping " << file_path << ": larger than 1 MB, use upload" << std::endl;
+            ++skipped;
+            continue;
+        }
+
+        std::string data(size, '\0');
+        infile.seekg(0);
+        infile.read(&data[0], size);
+        if (infile.gcount() != size) {
+            std::cerr << "Failed to read file: " << file_path << std::endl;
+            ++skipped;
+            continue;
+        }
+
+        BatchFile* file = frame.add_files();
+        file->set_file_name(file_path.substr(file_path.find_last_of("/\\") + 1));
+        file->set_data(std::move(data));
+        frame_bytes += size;
+
+        if (frame_bytes >= kBatchFrameBytes) {
+            stream_ok = writer->Write(frame);
+            frame.Clear();
+            frame_bytes = 0;
+            if (!stream_ok) break;
+        }
+    }
+    if (stream_ok && frame.files_size() > 0) {
+        stream_ok = writer->Write(frame);
+    }
+    if (stream_ok) {
+        writer->WritesDone();
+    }
+    grpc::Status status = writer->Finish();
+    if (!status.ok()) {
+        std::cout << "Batch upload failed: " << status.error_message() << std::endl;
+        return 0;
+    }
+
+    int uploaded = 0;
+    for (const auto& result : response.results()) {
+        if (result.success()) {
+            ++uploaded;
+        } else {
+            std::cout << "Upload failed: " << result.file_name() << ": " << result.message() << std::endl;
+        }
+    }
+    std::cout << "Batch upload: " << uploaded << " of " << (response.results_size() + skipped) << " files uploaded." << std::endl;
+    return uploaded;
+}
+
+int FileSyncClient::DownloadFileBatch(const std::vector<std::string>& file_names) {
+    BatchDownloadRequest request;
+    for (const auto& file_name : file_names) {
+        request.add_file_names(file_name);
+    }
+
+    tracing::Span batch_span(trace_, "sync.batch_download");
+    grpc::ClientContext context;
+    AttachTrace(context);
+    std::unique_ptr<grpc::ClientReader<BatchFileFrame>> reader(stub_->BatchDownload(&context, request));
+
+    int downloaded = 0;
+    BatchFileFrame frame;
+    while (reader->Read(&frame)) {
+        for (const auto& file : frame.files()) {
+            if (!file.error().empty()) {
+                std::cout << "Download failed: " << file.file_name() << ": " << file.error() << std::endl;
+                continue;
+            }
+            // File names come from the server; never let one escape the current directory
+            if (file.file_name().find_first_of("/\\") != std::string::npos || file.file_name() == "..") {
+                std::cout << "Download failed: refusing unsafe file name " << file.file_name() << std::endl;
+                continue;
+            }
+            utils::SHA256Hasher hasher;
+            hasher.Update(file.data().data(), file.data().size());
+            if (hasher.HexDigest() != file.file_hash()) {
+                std::cout << "Download failed: " << file.file_name() << ": hash mismatch" << std::endl;
+                continue;
+            }
+            std::ofstream outfile(file.file_name(), std::ios::binary);
+            outfile.write(file.data().data(), file.data().size());
+            if (!outfile) {
+                std::cout << "Download failed: could not write " << file.file_name() << std::endl;
+                continue;
+            }
+            ++downloaded;
+        }
+    }
+
+    grpc::Status status = reader->Finish();
+    if (!status.ok()) {
+        std::cout << "Batch download failed: " << status.error_message() << std::endl;
+    }
+    std::cout << "Batch download: " << downloaded << " of " << file_names.size() << " files downloaded." << std::endl;
+    return downloaded;
+}
+
+bool FileSyncClient::DownloadFileParallel(const std::string& file_name, const std::string& dest_path, int streams) {
+    FileRequest info_request;
+    info_request.set_file_name(file_name);
+    FileInfo info;
+    grpc::ClientContext info_context;
+    AttachTrace(info_context);
+    grpc::Status status = stub_->GetFileInfo(&info_context, info_request, &info);
+    if (!status.ok()) {
+        std::cout << "Download failed: " << status.error_message() << std::endl;
+        return false;
+    }
+
+    int64_t size = info.file_size();
+    if (streams < 1) streams = 1;
+
+    // Equal ranges rounded up to the alignment; small files use fewer streams
+    int64_t range_size = (size + streams - 1) / streams;
+    range_size = std::max(kRangeAlignment, (range_size + kRangeAlignment - 1) / kRangeAlignment * kRangeAlignment);
+    int num_ranges = static_cast<int>(std::max<int64_t>(1, (size + range_size - 1) / range_size));
+
+    tracing::Span download_span(trace_, "sync.download_parallel", file_name);
+    std::string part_path = dest_path + ".part";
+    int fd = ::open(part_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open destination file: " << part_path << std::endl;
+        return false;
+    }
+    // Reserve the whole file up front so concurrent pwrites never extend it
+    if (size > 0 && ::posix_fallocate(fd, 0, size) != 0 && ::ftruncate(fd, size) != 0) {
+        std::cerr << "Failed to preallocate " << size << " bytes for " << part_path << std::endl;
+        ::close(fd);
+        ::unlink(part_path.c_str());
+        return false;
+    }
+
+    std::vector<std::string> errors(num_ranges);
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < num_ranges; ++i) {
+        workers.emplace_back([&, i]() {
+            int64_t offset = i * range_size;
+            int64_t length = std::min(range_size, size - offset);
+            for (int attempt = 0; attempt < kRangeAttempts && !failed.load(); ++attempt) {
+                errors[i].clear();
+                if (DownloadRange(file_name, info.file_hash(), offset, length, fd, errors[i])) return;
+            }
+            failed.store(true);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    bool ok = !failed.load() && ::fsync(fd) == 0;
+    ::close(fd);
+    // Each range only proves it arrived intact. The whole file must also be the
+    // version GetFileInfo named, not ranges of two versions stitched together.
+    if (ok && utils::CalculateSHA256(part_path) != info.file_hash()) {
+        errors.push_back("Hash mismatch for " + file_name + ": it changed during the download");
+        ok = false;
+    }
+    if (ok && std::rename(part_path.c_str(), dest_path.c_str()) != 0) {
+        errors.push_back("Failed to rename " + part_path + " to " + dest_path);
+        ok = false;
+    }
+    if (!ok) {
+        ::unlink(part_path.c_str());
+        for (const auto& error : errors) {
+            if (!error.empty()) {
+                std::cout << "Download failed: " << error << std::endl;
+                break;
+            }
+        }
+        return false;
+    }
+
+    std::cout << "Download successful (" << num_ranges << " ranges, " << size << " bytes)." << std::endl;
+    return true;
+}
+
+bool FileSyncClient::DownloadRange(const std::string& file_name, const std::string& expected_hash,
+                                   int64_t offset, int64_t length, int fd, std::string& error) {
+    FileRequest request;
+    request.set_file_name(file_name);
+    request.set_offset(offset);
+    request.set_length(length);
+    request.set_expected_hash(expected_hash);
+
+    tracing::Span range_span(trace_, "sync.download_range", file_name);
+    grpc::ClientContext context;
+    AttachTrace(context);
+    std::unique_ptr<grpc::ClientReader<FileChunk>> reader(stub_->DownloadFile(&context, request));
+
+    utils::SHA256Hasher hasher;
+    int64_t next_offset = offset;
+    std::string range_hash;
+    FileChunk chunk;
+    while (reader->Read(&chunk)) {
+        // Chunks must arrive in order and stay inside the requested range
+        if (chunk.offset() != next_offset || next_offset + static_cast<int64_t>(chunk.data().size()) > offset + length) {
+            error = "Unexpected chunk at offset " + std::to_string(chunk.offset()) + " of " + file_name;
+            context.TryCancel();
+            break;
+        }
+        const char* data = chunk.data().data();
+        size_t remaining = chunk.data().size();
+        int64_t position = next_offset;
+        while (remaining > 0) {
+            ssize_t written = ::pwrite(fd, data, remaining, position);
+            if (written <= 0) {
+                error = "Failed to write " + file_name + ".part";
+                context.TryCancel();
+                break;
+            }
+            data += written;
+            remaining -= written;
+            position += written;
+        }
+        if (!error.empty()) break;
+        hasher.Update(chunk.data().data(), chunk.data().size());
+        next_offset += chunk.data().size();
+        if (chunk.is_last_chunk()) range_hash = chunk.range_hash();
+    }
+
+    grpc::Status status = reader->Finish();
+    if (!error.empty()) return false;
+    if (!status.ok()) {
+        error = status.error_message();
+        return false;
+    }
+    if (next_offset != offset + length) {
+        error = "Short range for " + file_name + " at offset " + std::to_string(offset);
+        return false;
+    }
+    if (length > 0 && hasher.HexDigest() != range_hash) {
+        error = "Hash mismatch for " + file_name + " range at offset " + std::to_string(offset);
+        return false;
+    }
+    return true;
+}
+
 } // namespace filesync
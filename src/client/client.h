@@ -6,6 +6,7 @@
 #include "crdt.grpc.pb.h"
 
 #include "../common/crdt_manager.h"
+#include "../common/tracing.h"
 
 namespace filesync {
 
@@ -15,16 +16,50 @@ public:
 
     bool UploadFile(const std::string& file_path);
     bool DownloadFile(const std::string& file_name, const std::string& dest_path);
+    // Split one file into byte ranges fetched over `streams` concurrent DownloadFile
+    // calls. Ranges are pwrite()n into a preallocated "<dest>.part" and the file is
+    // renamed into place only after every range hash has been verified.
+    bool DownloadFileParallel(const std::string& file_name, const std::string& dest_path, int streams);
+    
+    // Many small files (each at most 1 MB, at most 4096 per call) in one stream.
+    // Per-file failures are printed; returns the number of files transferred.
+    int UploadFileBatch(const std::vector<std::string>& file_paths);
+    // Downloaded files are written to their names in the current directory
+    int DownloadFileBatch(const std::vector<std::string>& file_names);
     
     // CRDT Operations
     void EditFile(const std::string& file_name, int index, char content);
-    void GetCRDTState(const std::string& file_name);
+    // Prints `length` characters from `offset` (0 = to the end) of the live text
+    void GetCRDTState(const std::string& file_name, int64_t offset = 0, int64_t length = 0);
+    // Load a synced file into a CRDT document, on the server and in this client's
+    // replica, so later edits can refer to its characters
+    bool OpenCRDTDocument(const std::string& file_name);
+    // Save the document's current text as a new synced version of the file
+    bool SaveCRDTDocument(const std::string& file_name);
     void Sync();
+    void PrintServerStats();
+    void PrintServerMetrics();
+
+    // Trace the next Sync (client spans + server spans under the same trace id)
+    // and write the client-side spans to `trace_path` as Chrome trace JSON.
+    void SetSyncTraceOutput(const std::string& trace_path);
+    // mode: "on", "off" or "dump"; dump writes the server's spans to `output_path`
+    bool ServerTrace(const std::string& mode, const std::string& output_path);
 
 private:
     std::unique_ptr<FileSyncService::Stub> stub_;
     std::unique_ptr<CRDTService::Stub> crdt_stub_;
     CRDTManager crdt_manager_;
+
+    // Fetch [offset, offset + length) of one version of a file into `fd`
+    bool DownloadRange(const std::string& file_name, const std::string& expected_hash,
+                       int64_t offset, int64_t length, int fd, std::string& error);
+
+    // Propagate the active trace id to the server
+    void AttachTrace(grpc::ClientContext& context) const;
+
+    tracing::TraceContext trace_;
+    std::string sync_trace_path_;
 };
 
 } // namespace filesync
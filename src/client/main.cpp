@@ -2,11 +2,17 @@
 // Client entry point
 #include <iostream>
 #include <ctime>
+#include <cstdlib>
 #include <sstream>
 #include <unistd.h>
+#include <vector>
 
 int main(int argc, char** argv) {
     std::string target_str = "localhost:50051";
+    // Point the client at another node, e.g. FILESYNC_SERVER=localhost:50062
+    if (const char* server = std::getenv("FILESYNC_SERVER")) {
+        target_str = server;
+    }
     // Generate a random client ID for CRDT
     std::srand(std::time(nullptr) + getpid());
     std::string client_id = "client_" + std::to_string(std::rand());
@@ -18,18 +24,51 @@ int main(int argc, char** argv) {
         if (command == "upload" && argc > 2) {
             client.UploadFile(argv[2]);
         } else if (command == "download" && argc > 3) {
-            client.DownloadFile(argv[2], argv[3]);
+            // ./filesync_client download <file> <dest> [--streams=N]
+            if (argc > 4 && std::string(argv[4]).rfind("--streams=", 0) == 0) {
+                client.DownloadFileParallel(argv[2], argv[3], std::stoi(std::string(argv[4]).substr(10)));
+            } else {
+                client.DownloadFile(argv[2], argv[3]);
+            }
+        } else if (command == "batch-upload" && argc > 2) {
+            // ./filesync_client batch-upload <file>...
+            client.UploadFileBatch(std::vector<std::string>(argv + 2, argv + argc));
+        } else if (command == "batch-download" && argc > 2) {
+            // ./filesync_client batch-download <file_name>...
+            client.DownloadFileBatch(std::vector<std::string>(argv + 2, argv + argc));
         } else if (command == "edit" && argc > 4) {
             // ./filesync_client edit <file> <index> <char>
             client.EditFile(argv[2], std::stoi(argv[3]), argv[4][0]);
         } else if (command == "cat" && argc > 2) {
-            // ./filesync_client cat <file>
-            client.GetCRDTState(argv[2]);
+            // ./filesync_client cat <file> [offset length]
+            if (argc > 4) {
+                client.GetCRDTState(argv[2], std::stoll(argv[3]), std::stoll(argv[4]));
+            } else {
+                client.GetCRDTState(argv[2]);
+            }
+        } else if (command == "open" && argc > 2) {
+            // ./filesync_client open <file>
+            client.OpenCRDTDocument(argv[2]);
+        } else if (command == "save" && argc > 2) {
+            // ./filesync_client save <file>
+            client.SaveCRDTDocument(argv[2]);
         } else if (command == "sync") {
-            // ./filesync_client sync
+            // ./filesync_client sync [--trace=<client_trace.json>]
+            if (argc > 2 && std::string(argv[2]).rfind("--trace=", 0) == 0) {
+                client.SetSyncTraceOutput(std::string(argv[2]).substr(8));
+            }
             client.Sync();
+        } else if (command == "trace" && argc > 2) {
+            // ./filesync_client trace on|off|dump [out.json]
+            client.ServerTrace(argv[2], argc > 3 ? argv[3] : "server_trace.json");
+        } else if (command == "stats") {
+            // ./filesync_client stats
+            client.PrintServerStats();
+        } else if (command == "metrics") {
+            // ./filesync_client metrics > filesync.prom
+            client.PrintServerMetrics();
         } else if (command == "interactive") {
-            std::cout << "Entering interactive mode. Commands: upload, download, edit, cat, sync, exit" << std::endl;
+            std::cout << "Entering interactive mode. Commands: upload, download, batch-upload, batch-download, edit, cat, open, save, sync, stats, metrics, trace, exit" << std::endl;
             std::string line;
             while (std::cout << "> " && std::getline(std::cin, line)) {
                 std::stringstream ss(line);
@@ -44,7 +83,24 @@ int main(int argc, char** argv) {
                     if (ss >> path) client.UploadFile(path);
                 } else if (cmd == "download") {
                     std::string name, path;
-                    if (ss >> name >> path) client.DownloadFile(name, path);
+                    int streams;
+                    if (ss >> name >> path) {
+                        if (ss >> streams) {
+                            client.DownloadFileParallel(name, path, streams);
+                        } else {
+                            client.DownloadFile(name, path);
+                        }
+                    }
+                } else if (cmd == "batch-upload" || cmd == "batch-download") {
+                    std::vector<std::string> names;
+                    std::string name;
+                    while (ss >> name) names.push_back(name);
+                    if (names.empty()) continue;
+                    if (cmd == "batch-upload") {
+                        client.UploadFileBatch(names);
+                    } else {
+                        client.DownloadFileBatch(names);
+                    }
                 } else if (cmd == "edit") {
                     std::string name;
                     int idx;
@@ -52,9 +108,31 @@ int main(int argc, char** argv) {
                     if (ss >> name >> idx >> c) client.EditFile(name, idx, c);
                 } else if (cmd == "cat") {
                     std::string name;
-                    if (ss >> name) client.GetCRDTState(name);
+                    int64_t offset = 0, length = 0;
+                    if (ss >> name) {
+                        ss >> offset >> length;
+                        client.GetCRDTState(name, offset, length);
+                    }
+                } else if (cmd == "open" || cmd == "save") {
+                    std::string name;
+                    if (!(ss >> name)) continue;
+                    if (cmd == "open") {
+                        client.OpenCRDTDocument(name);
+                    } else {
+                        client.SaveCRDTDocument(name);
+                    }
                 } else if (cmd == "sync") {
                     client.Sync();
+                } else if (cmd == "stats") {
+                    client.PrintServerStats();
+                } else if (cmd == "metrics") {
+                    client.PrintServerMetrics();
+                } else if (cmd == "trace") {
+                    std::string mode, path = "server_trace.json";
+                    if (ss >> mode) {
+                        ss >> path;
+                        client.ServerTrace(mode, path);
+                    }
                 } else {
                     std::cout << "Unknown command" << std::endl;
                 }
@@ -62,11 +140,18 @@ int main(int argc, char** argv) {
         } else {
             std::cout << "Usage: " << std::endl;
             std::cout << "  ./filesync_client interactive" << std::endl;
-            std::cout << "  ./filesync_client sync" << std::endl;
+            std::cout << "  ./filesync_client sync [--trace=<client_trace.json>]" << std::endl;
+            std::cout << "  ./filesync_client trace on|off|dump [out.json]" << std::endl;
+            std::cout << "  ./filesync_client stats" << std::endl;
+            std::cout << "  ./filesync_client metrics" << std::endl;
             std::cout << "  ./filesync_client upload <file>" << std::endl;
-            std::cout << "  ./filesync_client download <file_name> <dest_path>" << std::endl;
+            std::cout << "  ./filesync_client download <file_name> <dest_path> [--streams=N]" << std::endl;
+            std::cout << "  ./filesync_client batch-upload <file>..." << std::endl;
+            std::cout << "  ./filesync_client batch-download <file_name>..." << std::endl;
             std::cout << "  ./filesync_client edit <file_name> <index> <char>" << std::endl;
-            std::cout << "  ./filesync_client cat <file_name>" << std::endl;
+            std::cout << "  ./filesync_client cat <file_name> [offset length]" << std::endl;
+            std::cout << "  ./filesync_client open <file_name>" << std::endl;
+            std::cout << "  ./filesync_client save <file_name>" << std::endl;
         }
     } else {
         std::cout << "Usage: ./filesync_client <command> [args]" << std::endl;
@@ -0,0 +1,69 @@
+#include "transfer_pipeline.h"
+// Client transfer pipeline implementation
+#include <algorithm>
+
+namespace filesync {
+
+BufferRing::BufferRing(size_t buffers) : buffers_(buffers) {
+    for (auto& buffer : buffers_) empty_.push_back(&buffer);
+}
+
+BufferRing::Buffer* BufferRing::AcquireEmpty() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return closed_ || !empty_.empty(); });
+    if (closed_) return nullptr;
+    Buffer* buffer = empty_.front();
+    empty_.pop_front();
+    buffer->last = false;
+    return buffer;
+}
+
+void BufferRing::PushFull(Buffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        full_.push_back(buffer);
+    }
+    changed_.notify_all();
+}
+
+BufferRing::Buffer* BufferRing::PopFull() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return closed_ || !full_.empty(); });
+    if (closed_) return nullptr;
+    Buffer* buffer = full_.front();
+    full_.pop_front();
+    return buffer;
+}
+
+void BufferRing::Recycle(Buffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        empty_.push_back(buffer);
+    }
+    changed_.notify_all();
+}
+
+void BufferRing::Close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    changed_.notify_all();
+}
+
+ChunkSizer::ChunkSizer(size_t initial) : size_(std::min(std::max(initial, kMinChunkSize), kMaxChunkSize)) {}
+
+void ChunkSizer::Record(size_t bytes, std::chrono::steady_clock::duration elapsed) {
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    if (bytes == 0 || seconds <= 0) return;
+    double rate = bytes / seconds;
+    bytes_per_second_ = bytes_per_second_ == 0 ? rate : 0.7 * bytes_per_second_ + 0.3 * rate;
+
+    // Power of two nearest below the target, so sizes do not jitter chunk to chunk
+    double target = bytes_per_second_ * std::chrono::duration<double>(kTargetChunkTime).count();
+    size_t chunk = kMinChunkSize;
+    while (chunk < kMaxChunkSize && chunk * 2 <= target) chunk *= 2;
+    size_.store(chunk, std::memory_order_relaxed);
+}
+
+} // namespace filesync
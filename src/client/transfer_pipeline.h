@@ -0,0 +1,68 @@
+#pragma once
+// Client transfer pipeline header
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace filesync {
+
+// Fixed ring of reusable buffers handed between a disk thread and the network
+// thread, so the file I/O for one chunk overlaps the RPC for another. Buffers
+// keep their capacity on every trip round the ring, so the steady state does not
+// allocate.
+class BufferRing {
+public:
+    struct Buffer {
+        std::string data;
+        bool last = false; // Final buffer of the transfer
+    };
+
+    explicit BufferRing(size_t buffers);
+
+    // Producer side: an empty buffer to fill (blocks), or nullptr once closed
+    Buffer* AcquireEmpty();
+    void PushFull(Buffer* buffer);
+
+    // Consumer side: the next filled buffer in order (blocks), or nullptr once closed
+    Buffer* PopFull();
+    void Recycle(Buffer* buffer);
+
+    // Aborts the transfer: wakes both sides, which then see nullptr
+    void Close();
+
+private:
+    std::vector<Buffer> buffers_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<Buffer*> empty_;
+    std::deque<Buffer*> full_;
+    bool closed_ = false;
+};
+
+// Picks the upload chunk size from measured throughput, aiming for each chunk to
+// take about kTargetChunkTime on the wire: slow links get small chunks so the
+// pipeline stays full, fast links get large ones to amortize per-chunk overhead.
+class ChunkSizer {
+public:
+    static constexpr size_t kMinChunkSize = 64 * 1024;
+    // The size of the server's registered io_uring buffer; larger chunks would be
+    // written without WRITE_FIXED
+    static constexpr size_t kMaxChunkSize = 1024 * 1024;
+    static constexpr std::chrono::milliseconds kTargetChunkTime{25};
+
+    explicit ChunkSizer(size_t initial);
+
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+    void Record(size_t bytes, std::chrono::steady_clock::duration elapsed);
+
+private:
+    std::atomic<size_t> size_;
+    double bytes_per_second_ = 0; // Moving average
+};
+
+} // namespace filesync
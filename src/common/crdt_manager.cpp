@@ -1,150 +1,460 @@
 #include "crdt_manager.h"
 // CRDT logic implementation
 #include <algorithm>
+#include <atomic>
+#include <limits>
 
 namespace filesync {
 
+namespace {
+
+// Elements per segment before it is split in two
+const size_t kSegmentSize = 512;
+// Characters per snapshot chunk before it is split in two; an edit copies one chunk
+const size_t kMaxChunkSize = 2048;
+// Children per snapshot tree node before it is split in two; an edit copies one
+// node per level
+const size_t kFanout = 32;
+// Lamport clocks are int32 on the wire; an imported run must end at or below this
+const int32_t kMaxClock = std::numeric_limits<int32_t>::max();
+
+bool IsStartOfFile(const CharID& id) {
+    return id.clock == 0 && id.site_id.empty();
+}
+
+} // namespace
+
+std::string TextSnapshot::ToString() const {
+    return Substr(0, size());
+}
+
+std::string TextSnapshot::Substr(size_t offset, size_t length) const {
+    std::string text;
+    if (offset >= size() || length == 0) return text;
+    length = std::min(length, size() - offset);
+    text.reserve(length);
+    Append(*root_, offset, length, text);
+    return text;
+}
+
+void TextSnapshot::Append(const Node& node, size_t offset, size_t length, std::string& text) {
+    if (node.children.empty()) {
+        text.append(node.text, offset, length);
+        return;
+    }
+    for (const auto& child : node.children) {
+        if (length == 0) return;
+        if (offset >= child->size) {
+            offset -= child->size;
+            continue;
+        }
+        size_t take = std::min(length, child->size - offset);
+        Append(*child, offset, take, text);
+        offset = 0;
+        length -= take;
+    }
+}
+
+std::shared_ptr<const TextSnapshot> TextSnapshot::FromText(const std::string& text) {
+    auto snapshot = std::make_shared<TextSnapshot>();
+    std::vector<NodePtr> level;
+    for (size_t offset = 0; offset < text.size(); offset += kMaxChunkSize / 2) {
+        auto leaf = std::make_shared<Node>();
+        leaf->text = text.substr(offset, kMaxChunkSize / 2);
+        leaf->size = leaf->text.size();
+        level.push_back(std::move(leaf));
+    }
+    // Group each level into half-full parents until one root is left
+    while (level.size() > 1) {
+        std::vector<NodePtr> parents;
+        for (size_t begin = 0; begin < level.size(); begin += kFanout / 2) {
+            auto parent = std::make_shared<Node>();
+            for (size_t i = begin; i < std::min(level.size(), begin + kFanout / 2); ++i) {
+                parent->size += level[i]->size;
+                parent->children.push_back(std::move(level[i]));
+            }
+            parents.push_back(std::move(parent));
+        }
+        level = std::move(parents);
+    }
+    if (!level.empty()) snapshot->root_ = std::move(level[0]);
+    return snapshot;
+}
+
+TextSnapshot::NodePtr TextSnapshot::Insert(const NodePtr& node, size_t position, char content, NodePtr& split) {
+    auto copy = std::make_shared<Node>();
+    copy->size = node->size + 1;
+    if (node->children.empty()) {
+        copy->text.reserve(node->text.size() + 1);
+        copy->text.append(node->text, 0, position);
+        copy->text += content;
+        copy->text.append(node->text, position, std::string::npos);
+        if (copy->text.size() > kMaxChunkSize) {
+            auto right = std::make_shared<Node>();
+            right->text = copy->text.substr(copy->text.size() / 2);
+            right->size = right->text.size();
+            copy->text.resize(copy->text.size() / 2);
+            copy->size = copy->text.size();
+            split = std::move(right);
+        }
+        return copy;
+    }
+
+    // Descend into the first child that reaches `position`
+    size_t index = 0;
+    while (index + 1 < node->children.size() && position > node->children[index]->size) {
+        position -= node->children[index]->size;
+        ++index;
+    }
+    copy->children = node->children;
+    NodePtr child_split;
+    copy->children[index] = Insert(node->children[index], position, content, child_split);
+    if (child_split) copy->children.insert(copy->children.begin() + index + 1, std::move(child_split));
+
+    if (copy->children.size() > kFanout) {
+        auto right = std::make_shared<Node>();
+        size_t half = copy->children.size() / 2;
+        right->children.assign(copy->children.begin() + half, copy->children.end());
+        copy->children.resize(half);
+        for (const auto& child : right->children) right->size += child->size;
+        copy->size -= right->size;
+        split = std::move(right);
+    }
+    return copy;
+}
+
+TextSnapshot::NodePtr TextSnapshot::Erase(const NodePtr& node, size_t position) {
+    if (node->size == 1) return nullptr;
+    auto copy = std::make_shared<Node>();
+    copy->size = node->size - 1;
+    if (node->children.empty()) {
+        copy->text = node->text;
+        copy->text.erase(position, 1);
+        return copy;
+    }
+
+    size_t index = 0;
+    while (position >= node->children[index]->size) {
+        position -= node->children[index]->size;
+        ++index;
+    }
+    copy->children = node->children;
+    NodePtr child = Erase(node->children[index], position);
+    if (child) {
+        copy->children[index] = std::move(child);
+    } else {
+        copy->children.erase(copy->children.begin() + index);
+    }
+    return copy;
+}
+
+std::shared_ptr<const TextSnapshot> TextSnapshot::WithInsert(size_t position, char content) const {
+    auto next = std::make_shared<TextSnapshot>();
+    if (!root_) {
+        auto leaf = std::make_shared<Node>();
+        leaf->text.assign(1, content);
+        leaf->size = 1;
+        next->root_ = std::move(leaf);
+        return next;
+    }
+
+    NodePtr split;
+    next->root_ = Insert(root_, position, content, split);
+    if (split) {
+        // The root overflowed; the tree grows by one level
+        auto root = std::make_shared<Node>();
+        root->size = next->root_->size + split->size;
+        root->children = {std::move(next->root_), std::move(split)};
+        next->root_ = std::move(root);
+    }
+    return next;
+}
+
+std::shared_ptr<const TextSnapshot> TextSnapshot::WithErase(size_t position) const {
+    auto next = std::make_shared<TextSnapshot>();
+    next->root_ = Erase(root_, position);
+    // Drop roots left with a single child
+    while (next->root_ && next->root_->children.size() == 1) {
+        NodePtr child = next->root_->children[0];
+        next->root_ = std::move(child);
+    }
+    return next;
+}
+
 CRDTManager::CRDTManager(std::string site_id) : site_id_(site_id), clock_(0) {}
 
-std::list<RGANode>::iterator CRDTManager::FindNode(std::list<RGANode>& nodes, CharID id) {
-    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
-        if (it->id == id) return it;
+CRDTManager::Document& CRDTManager::GetDocument(const std::string& file_name) {
+    if (Document* doc = FindDocument(file_name)) return *doc;
+
+    std::unique_lock<std::shared_mutex> lock(files_mutex_);
+    auto& doc = files_[file_name];
+    if (!doc) {
+        doc = std::make_unique<Document>();
+        doc->text = std::make_shared<const TextSnapshot>();
     }
-    return nodes.end();
+    return *doc;
+}
+
+CRDTManager::Document* CRDTManager::FindDocument(const std::string& file_name) {
+    std::shared_lock<std::shared_mutex> lock(files_mutex_);
+    auto it = files_.find(file_name);
+    return it == files_.end() ? nullptr : it->second.get();
+}
+
+std::list<CRDTManager::Element>::iterator CRDTManager::FindNode(Document& doc, const CharID& id, size_t& offset) {
+    auto site = doc.index.find(id.site_id);
+    if (site == doc.index.end()) return doc.nodes.end();
+    auto run = site->second.upper_bound(id.clock);
+    if (run == site->second.begin()) return doc.nodes.end();
+    auto it = std::prev(run)->second;
+    int64_t delta = static_cast<int64_t>(id.clock) - it->id.clock;
+    if (delta >= static_cast<int64_t>(it->content.size())) return doc.nodes.end();
+    offset = static_cast<size_t>(delta);
+    return it;
+}
+
+std::list<CRDTManager::Element>::iterator CRDTManager::SplitRun(Document& doc, std::list<Element>::iterator it, size_t offset) {
+    Element right;
+    right.id = {it->id.site_id, it->id.clock + static_cast<int32_t>(offset)};
+    right.origin_left = {it->id.site_id, right.id.clock - 1};
+    right.content = it->content.substr(offset);
+    right.is_deleted = it->is_deleted;
+    right.segment = nullptr;
+    it->content.resize(offset);
+    if (!it->is_deleted) it->segment->visible -= right.content.size();
+
+    auto next = doc.nodes.insert(std::next(it), std::move(right));
+    doc.index[next->id.site_id][next->id.clock] = next;
+    AddToSegment(doc, next);
+    return next;
+}
+
+size_t CRDTManager::VisiblePosition(Document& doc, std::list<Element>::iterator it) {
+    size_t position = 0;
+    for (const auto& segment : doc.segments) {
+        if (&segment == it->segment) break;
+        position += segment.visible;
+    }
+    for (auto walk = it->segment->first; walk != it; ++walk) {
+        if (!walk->is_deleted) position += walk->content.size();
+    }
+    return position;
+}
+
+void CRDTManager::AddToSegment(Document& doc, std::list<Element>::iterator it) {
+    // Join the left neighbour's segment, or the right one's when inserted at the front
+    Segment* segment;
+    if (it != doc.nodes.begin()) {
+        segment = std::prev(it)->segment;
+    } else if (std::next(it) != doc.nodes.end()) {
+        segment = std::next(it)->segment;
+        segment->first = it;
+    } else {
+        doc.segments.emplace_back();
+        segment = &doc.segments.back();
+        segment->first = it;
+    }
+    it->segment = segment;
+    segment->size++;
+    if (!it->is_deleted) segment->visible += it->content.size();
+
+    if (segment->size <= 2 * kSegmentSize) return;
+
+    auto pos = std::find_if(doc.segments.begin(), doc.segments.end(), [&](const Segment& s) { return &s == segment; });
+    auto tail = doc.segments.emplace(std::next(pos));
+    auto walk = segment->first;
+    std::advance(walk, segment->size / 2);
+    tail->first = walk;
+    for (size_t moved = segment->size - segment->size / 2; moved > 0; --moved, ++walk) {
+        walk->segment = &*tail;
+        tail->size++;
+        if (!walk->is_deleted) tail->visible += walk->content.size();
+    }
+    segment->size -= tail->size;
+    segment->visible -= tail->visible;
+}
+
+void CRDTManager::Publish(Document& doc, std::shared_ptr<const TextSnapshot> text) {
+    std::atomic_store(&doc.text, std::move(text));
 }
 
 void CRDTManager::ApplyInsert(const std::string& file_name, char content, CharID id, CharID origin_left) {
-    auto& nodes = files_[file_name];
-    
+    Document& doc = GetDocument(file_name);
+    std::lock_guard<std::mutex> lock(doc.mutex);
+    Insert(doc, content, id, origin_left);
+}
+
+void CRDTManager::Insert(Document& doc, char content, const CharID& id, const CharID& origin_left) {
     // Check if already applied (idempotency)
-    if (FindNode(nodes, id) != nodes.end()) return;
-
-    // Find insertion point
-    auto it = nodes.begin();
-    
-    // If origin_left is empty (start of file), start at beginning
-    // Otherwise, find the origin_left node
-    if (origin_left.clock != 0 || !origin_left.site_id.empty()) {
-        auto left_it = FindNode(nodes, origin_left);
-        if (left_it != nodes.end()) {
+    size_t offset;
+    if (FindNode(doc, id, offset) != doc.nodes.end()) return;
+
+    // Find insertion point: just after origin_left, or the start of the file
+    auto it = doc.nodes.begin();
+    if (!IsStartOfFile(origin_left)) {
+        auto left_it = FindNode(doc, origin_left, offset);
+        if (left_it != doc.nodes.end()) {
+            if (offset + 1 < left_it->content.size()) SplitRun(doc, left_it, offset + 1);
             it = std::next(left_it);
         }
     }
 
-    // RGA Rule: Skip over nodes that have a greater ID (concurrently inserted to the right)
-    // We keep skipping as long as the current node's origin_left is the same as ours, 
-    // AND the current node's ID is greater than ours.
-    // Actually, simplified RGA: Skip nodes that are to the right of our origin_left 
-    // but have a higher priority (ID > our ID).
-    
-    // RGA Rule: Skip over nodes that have a greater ID (concurrently inserted to the right)
-    // We keep skipping as long as the current node's origin_left is the same as ours, 
-    // AND the current node's ID is greater than ours.
-    // Actually, simplified RGA: Skip nodes that are to the right of our origin_left 
-    // but have a higher priority (ID > our ID).
-    
-    // Let's try to be robust:
-    it = nodes.begin();
-    if (origin_left.clock != 0 || !origin_left.site_id.empty()) {
-        auto left_it = FindNode(nodes, origin_left);
-        if (left_it != nodes.end()) {
-            it = std::next(left_it);
-        }
+    // RGA rule: skip nodes with a greater ID. Those are concurrent inserts after the
+    // same origin_left that win the tie, plus everything inserted after them (which
+    // has a later clock still); the newest insert at a position ends up first. The
+    // rest of a run has greater IDs than its first character, so runs skip whole.
+    while (it != doc.nodes.end() && id < it->id) {
+        ++it;
     }
-    
-    while (it != nodes.end() && it->origin_left == origin_left && it->id < id) {
-         ++it;
-    }
-    
-    RGANode node;
-    node.id = id;
-    node.content = content;
-    node.is_deleted = false;
-    node.origin_left = origin_left;
-    
-    nodes.insert(it, node);
-    
+
+    size_t position;
+    auto prev = it == doc.nodes.begin() ? doc.nodes.end() : std::prev(it);
+    if (prev != doc.nodes.end() && !prev->is_deleted && origin_left == prev->LastId() &&
+        id.site_id == origin_left.site_id && id.clock == origin_left.clock + 1) {
+        // Typing straight after one's own run extends it
+        prev->content += content;
+        prev->segment->visible++;
+        position = VisiblePosition(doc, prev) + prev->content.size() - 1;
+    } else {
+        Element element;
+        element.id = id;
+        element.origin_left = origin_left;
+        element.content = std::string(1, content);
+        element.is_deleted = false;
+        element.segment = nullptr;
+
+        it = doc.nodes.insert(it, std::move(element));
+        doc.index[id.site_id][id.clock] = it;
+        AddToSegment(doc, it);
+        position = VisiblePosition(doc, it);
+    }
+    doc.unedited_import = false;
+    Publish(doc, doc.text->WithInsert(position, content));
+
     // Update logic clock
+    std::lock_guard<std::mutex> clock_lock(clock_mutex_);
     if (id.clock > clock_) clock_ = id.clock;
 }
 
 void CRDTManager::ApplyDelete(const std::string& file_name, CharID target_id) {
-    auto& nodes = files_[file_name];
-    auto it = FindNode(nodes, target_id);
-    if (it != nodes.end()) {
-        it->is_deleted = true;
-    }
+    Document& doc = GetDocument(file_name);
+    std::lock_guard<std::mutex> lock(doc.mutex);
+    size_t offset;
+    auto it = FindNode(doc, target_id, offset);
+    if (it == doc.nodes.end() || it->is_deleted) return;
+
+    // Cut the character out into its own element
+    if (offset > 0) it = SplitRun(doc, it, offset);
+    if (it->content.size() > 1) SplitRun(doc, it, 1);
+
+    size_t position = VisiblePosition(doc, it);
+    it->is_deleted = true;
+    it->segment->visible--;
+    doc.unedited_import = false;
+    Publish(doc, doc.text->WithErase(position));
 }
 
 CRDTManager::LocalInsertOp CRDTManager::LocalInsert(const std::string& file_name, int index, char content) {
-    auto& nodes = files_[file_name];
-    clock_++;
-    
+    Document& doc = GetDocument(file_name);
+    std::lock_guard<std::mutex> lock(doc.mutex);
+
     CharID id;
     id.site_id = site_id_;
-    id.clock = clock_;
-    
+    {
+        std::lock_guard<std::mutex> clock_lock(clock_mutex_);
+        id.clock = ++clock_;
+    }
+
+    // origin_left is the index-th visible character (1-based). At index 0 it is the
+    // character just before the first visible one; past the end it is the last one.
     CharID origin_left;
     origin_left.clock = 0; // Default (start of file)
-    
-    // Find the node at 'index' to determine origin_left
-    // We need to skip deleted nodes to find the visual index
-    int current_visual_index = 0;
-    auto it = nodes.begin();
-    auto prev_it = nodes.end();
-    
-    while (it != nodes.end()) {
-        if (!it->is_deleted) {
-            if (current_visual_index == index) {
-                // Insert before this node. So origin_left is the node BEFORE 'it'.
+    size_t remaining = static_cast<size_t>(std::max(index, 0));
+    auto segment = doc.segments.begin();
+    while (segment != doc.segments.end() && (index == 0 ? segment->visible == 0 : segment->visible < remaining)) {
+        remaining -= segment->visible;
+        ++segment;
+    }
+    if (segment == doc.segments.end()) {
+        if (!doc.nodes.empty()) origin_left = doc.nodes.back().LastId();
+    } else {
+        for (auto walk = segment->first;; ++walk) {
+            if (walk->is_deleted) continue;
+            if (index == 0) {
+                if (walk != doc.nodes.begin()) origin_left = std::prev(walk)->LastId();
                 break;
             }
-            current_visual_index++;
-        }
-        prev_it = it;
-        ++it;
-    }
-    
-    if (prev_it != nodes.end()) {
-        origin_left = prev_it->id;
-    } else if (it != nodes.begin()) {
-         // If we are at end, prev_it should be the last node
-         // Wait, the loop logic is a bit off for "append".
-         // Let's simplify:
-         // If index is 0, origin_left is empty/null.
-         // If index > 0, find the (index-1)-th visible character. That is our origin_left.
-    }
-    
-    // Correct logic for finding origin_left based on visual index:
-    if (index > 0) {
-        int visible_count = 0;
-        for (auto& node : nodes) {
-            if (!node.is_deleted) {
-                visible_count++;
-                if (visible_count == index) {
-                    origin_left = node.id;
-                    break;
-                }
+            if (walk->content.size() >= remaining) {
+                origin_left = {walk->id.site_id, walk->id.clock + static_cast<int32_t>(remaining) - 1};
+                break;
             }
+            remaining -= walk->content.size();
         }
     }
-    
+
     // Apply locally
-    ApplyInsert(file_name, content, id, origin_left);
-    
+    Insert(doc, content, id, origin_left);
+
     return {content, id, origin_left};
 }
 
+bool CRDTManager::Import(const std::string& file_name, const std::string& text, const CharID& first_id,
+                         const std::string& source) {
+    if (first_id.clock < 1 || text.size() > static_cast<size_t>(kMaxClock - first_id.clock) + 1) return false;
+    Document& doc = GetDocument(file_name);
+    std::lock_guard<std::mutex> lock(doc.mutex);
+    if (!doc.nodes.empty()) return false;
+    doc.imported = {first_id, text.size(), source};
+    doc.unedited_import = true;
+    if (text.empty()) return true;
+
+    Element element;
+    element.id = first_id;
+    element.origin_left.clock = 0; // Start of file
+    element.content = text;
+    element.is_deleted = false;
+    element.segment = nullptr;
+    auto it = doc.nodes.insert(doc.nodes.end(), std::move(element));
+    doc.index[first_id.site_id][first_id.clock] = it;
+    AddToSegment(doc, it);
+    Publish(doc, TextSnapshot::FromText(text));
+
+    std::lock_guard<std::mutex> clock_lock(clock_mutex_);
+    int32_t last_clock = it->LastId().clock;
+    if (last_clock > clock_) clock_ = last_clock;
+    return true;
+}
+
+bool CRDTManager::ReserveIds(size_t count, CharID& first_id) {
+    std::lock_guard<std::mutex> clock_lock(clock_mutex_);
+    if (count > static_cast<size_t>(kMaxClock - clock_)) return false;
+    first_id = {site_id_, clock_ + 1};
+    clock_ += static_cast<int32_t>(count);
+    return true;
+}
+
+bool CRDTManager::GetImportedRun(const std::string& file_name, ImportedRun& run) {
+    Document* doc = FindDocument(file_name);
+    if (!doc) return false;
+    std::lock_guard<std::mutex> lock(doc->mutex);
+    if (!doc->unedited_import) return false;
+    run = doc->imported;
+    return true;
+}
+
+bool CRDTManager::HasDocument(const std::string& file_name) {
+    return FindDocument(file_name) != nullptr;
+}
+
 std::string CRDTManager::GetText(const std::string& file_name) {
-    std::string text;
-    if (files_.find(file_name) == files_.end()) return "";
-    
-    for (const auto& node : files_[file_name]) {
-        if (!node.is_deleted) {
-            text += node.content;
-        }
-    }
-    return text;
+    return Snapshot(file_name)->ToString();
+}
+
+std::shared_ptr<const TextSnapshot> CRDTManager::Snapshot(const std::string& file_name) {
+    static const auto empty = std::make_shared<const TextSnapshot>();
+    Document* doc = FindDocument(file_name);
+    if (!doc) return empty;
+    return std::atomic_load(&doc->text);
 }
 
 } // namespace filesync
@@ -5,6 +5,10 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 #include <iostream>
 
 namespace filesync {
@@ -17,7 +21,7 @@ struct CharID {
     bool operator==(const CharID& other) const {
         return site_id == other.site_id && clock == other.clock;
     }
-    
+
     // Lexicographical comparison for RGA ordering
     bool operator<(const CharID& other) const {
         if (clock != other.clock) return clock < other.clock;
@@ -25,12 +29,44 @@ struct CharID {
     }
 };
 
-// A character in the text
-struct RGANode {
-    CharID id;
-    char content;
-    bool is_deleted;
-    CharID origin_left; // The ID of the character to the left when this was inserted
+// Immutable view of a document's visible text, kept as a persistent B-tree of
+// shared chunks. Writers publish a new snapshot per operation that copies only
+// the path from the root to the chunk they touch (O(log n) nodes and one chunk),
+// so a reader holding one is never blocked and never sees a half-applied edit.
+class TextSnapshot {
+public:
+    size_t size() const { return root_ ? root_->size : 0; }
+    std::string ToString() const;
+    // Up to `length` characters starting at `offset`
+    std::string Substr(size_t offset, size_t length) const;
+
+private:
+    friend class CRDTManager;
+
+    // Leaves hold a chunk of text; inner nodes hold up to kFanout children. Nodes
+    // are never modified once shared, and are not merged when they shrink: an
+    // emptied chunk or node is simply dropped.
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+    struct Node {
+        size_t size = 0;               // Characters below this node
+        std::string text;              // Leaf chunk
+        std::vector<NodePtr> children; // Empty for a leaf
+    };
+
+    // Snapshot of `text` split into half-full chunks and nodes
+    static std::shared_ptr<const TextSnapshot> FromText(const std::string& text);
+    std::shared_ptr<const TextSnapshot> WithInsert(size_t position, char content) const;
+    std::shared_ptr<const TextSnapshot> WithErase(size_t position) const;
+
+    // Copy of `node` with `content` inserted; an overflowing copy is split and its
+    // right half returned in `split`
+    static NodePtr Insert(const NodePtr& node, size_t position, char content, NodePtr& split);
+    // Copy of `node` without the character at `position`; null once it is empty
+    static NodePtr Erase(const NodePtr& node, size_t position);
+    static void Append(const Node& node, size_t offset, size_t length, std::string& text);
+
+    NodePtr root_; // Null for an empty document
 };
 
 class CRDTManager {
@@ -50,18 +86,91 @@ public:
     };
     LocalInsertOp LocalInsert(const std::string& file_name, int index, char content);
 
+    // Bulk-load `text` into an empty document as one run of IDs: character i gets
+    // (first_id.site_id, first_id.clock + i) and follows character i - 1, exactly
+    // as if inserted one by one, but in a single O(n) pass. Replicas that import
+    // the same run end up identical. `source` tags the run (e.g. the file version).
+    // Returns false if the document has content or the run would overflow the clock.
+    bool Import(const std::string& file_name, const std::string& text, const CharID& first_id,
+                const std::string& source = "");
+    // First ID of a fresh run of `count` IDs from this site's clock; false if the
+    // clock cannot advance that far
+    bool ReserveIds(size_t count, CharID& first_id);
+
+    struct ImportedRun {
+        CharID first_id;
+        size_t length = 0;
+        std::string source;
+    };
+    // The run a document was imported as, if nothing has changed it since
+    bool GetImportedRun(const std::string& file_name, ImportedRun& run);
+
     // Get the current text content
     std::string GetText(const std::string& file_name);
+    bool HasDocument(const std::string& file_name);
+
+    // Current materialized text; cheap, and safe to read while edits are applied
+    std::shared_ptr<const TextSnapshot> Snapshot(const std::string& file_name);
 
 private:
+    // Consecutive run of elements with its visible-character count, so the visible
+    // position of an element costs O(segments + segment length) instead of O(n)
+    struct Segment;
+
+    // A run of characters from one site with consecutive clocks: character k has
+    // ID (id.site_id, id.clock + k) and, for k > 0, origin_left character k - 1.
+    // A run is split when an insert or delete lands inside it, so an imported file
+    // or a stretch of typing stays one element.
+    struct Element {
+        CharID id;          // ID of the first character
+        CharID origin_left; // origin_left of the first character
+        std::string content;
+        bool is_deleted;
+        Segment* segment;
+
+        CharID LastId() const { return {id.site_id, id.clock + static_cast<int32_t>(content.size()) - 1}; }
+    };
+
+    struct Segment {
+        std::list<Element>::iterator first;
+        size_t size = 0;    // Elements
+        size_t visible = 0; // Visible characters
+    };
+
+    struct Document {
+        std::mutex mutex; // Serializes writers; readers only load `text`
+        std::list<Element> nodes;
+        // site_id -> first clock of each run -> run
+        std::unordered_map<std::string, std::map<int32_t, std::list<Element>::iterator>> index;
+        std::list<Segment> segments;
+        std::shared_ptr<const TextSnapshot> text; // Accessed with std::atomic_load/store
+        ImportedRun imported;
+        bool unedited_import = false; // Cleared by the first insert or delete
+    };
+
+    Document& GetDocument(const std::string& file_name);
+    Document* FindDocument(const std::string& file_name);
+
+    // ApplyInsert body; the caller holds doc.mutex
+    void Insert(Document& doc, char content, const CharID& id, const CharID& origin_left);
+
+    // Run holding the character `id`, and the character's offset in it
+    std::list<Element>::iterator FindNode(Document& doc, const CharID& id, size_t& offset);
+    // Split a run before `offset`; returns the new right-hand run
+    std::list<Element>::iterator SplitRun(Document& doc, std::list<Element>::iterator it, size_t offset);
+    // Number of visible characters before `it`
+    size_t VisiblePosition(Document& doc, std::list<Element>::iterator it);
+    // Link a newly inserted element into the segment of its left neighbour
+    void AddToSegment(Document& doc, std::list<Element>::iterator it);
+    void Publish(Document& doc, std::shared_ptr<const TextSnapshot> text);
+
     std::string site_id_;
     int32_t clock_;
-    
-    // Map file_name -> List of RGA Nodes
-    std::map<std::string, std::list<RGANode>> files_;
-    
-    // Helper to find a node by ID
-    std::list<RGANode>::iterator FindNode(std::list<RGANode>& nodes, CharID id);
+    std::mutex clock_mutex_;
+
+    // Map file_name -> Document; documents are never removed, so references stay valid
+    std::shared_mutex files_mutex_;
+    std::map<std::string, std::unique_ptr<Document>> files_;
 };
 
 } // namespace filesync
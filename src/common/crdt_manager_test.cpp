@@ -0,0 +1,285 @@
+#include "crdt_manager.h"
+// RGA convergence tests for CRDTManager
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace filesync {
+
+namespace {
+
+const std::string kDoc = "doc.txt";
+// Every site imports the shared base text as this run
+const CharID kImportId = {"import", 1};
+
+struct Op {
+    bool is_insert;
+    char content;
+    CharID id;          // Inserted character, or the deleted one
+    CharID origin_left; // Inserts only
+};
+
+bool IsStartOfFile(const CharID& id) {
+    return id.clock == 0 && id.site_id.empty();
+}
+
+std::string RandomText(std::mt19937& rng, size_t max_length) {
+    std::string text(rng() % (max_length + 1), ' ');
+    for (auto& c : text) c = static_cast<char>('a' + rng() % 26);
+    return text;
+}
+
+void Apply(CRDTManager& site, const Op& op) {
+    if (op.is_insert) {
+        site.ApplyInsert(kDoc, op.content, op.id, op.origin_left);
+    } else {
+        site.ApplyDelete(kDoc, op.id);
+    }
+}
+
+// Import `base`, then apply `ops` in a random order that still delivers every
+// op after the character it refers to, as any causal transport would
+void ApplyShuffled(CRDTManager& site, const std::string& base, std::vector<Op> ops, std::mt19937& rng) {
+    site.Import(kDoc, base, kImportId);
+    std::shuffle(ops.begin(), ops.end(), rng);
+    std::set<std::pair<std::string, int32_t>> present;
+    for (size_t i = 0; i < base.size(); ++i) present.insert({kImportId.site_id, kImportId.clock + static_cast<int32_t>(i)});
+    std::vector<bool> applied(ops.size(), false);
+    size_t remaining = ops.size();
+    while (remaining > 0) {
+        for (size_t i = 0; i < ops.size(); ++i) {
+            if (applied[i]) continue;
+            const Op& op = ops[i];
+            const CharID& dependency = op.is_insert ? op.origin_left : op.id;
+            if (!IsStartOfFile(dependency) && !present.count({dependency.site_id, dependency.clock})) continue;
+            Apply(site, op);
+            if (op.is_insert) present.insert({op.id.site_id, op.id.clock});
+            applied[i] = true;
+            remaining--;
+        }
+    }
+}
+
+// One site against a plain string: inserts and deletes land where they were asked
+// to, including inside and around an imported run
+bool TestSingleSite(std::mt19937& rng) {
+    for (int round = 0; round < 20; ++round) {
+        CRDTManager site("solo");
+        std::vector<std::pair<CharID, char>> model; // Visible characters in order
+        if (round % 2 == 1) {
+            std::string base = RandomText(rng, 500);
+            CharID first_id;
+            if (!site.ReserveIds(base.size(), first_id) || !site.Import(kDoc, base, first_id)) {
+                std::cerr << "single site: import failed in round " << round << std::endl;
+                return false;
+            }
+            for (size_t i = 0; i < base.size(); ++i) {
+                model.push_back({{first_id.site_id, first_id.clock + static_cast<int32_t>(i)}, base[i]});
+            }
+        }
+        for (int step = 0; step < 2000; ++step) {
+            if (!model.empty() && rng() % 4 == 0) {
+                size_t index = rng() % model.size();
+                site.ApplyDelete(kDoc, model[index].first);
+                model.erase(model.begin() + index);
+            } else {
+                size_t index = rng() % (model.size() + 1);
+                char content = static_cast<char>('a' + rng() % 26);
+                auto op = site.LocalInsert(kDoc, static_cast<int>(index), content);
+                model.insert(model.begin() + index, {op.id, content});
+            }
+        }
+        std::string expected;
+        for (const auto& entry : model) expected += entry.second;
+        if (site.GetText(kDoc) != expected) {
+            std::cerr << "single site: text differs from model in round " << round << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Three sites edit concurrently and exchange ops at random points; every site,
+// and fresh replicas fed the whole log in other causal orders, must agree. Odd
+// rounds start every site from the same imported file.
+bool TestConvergence(std::mt19937& rng) {
+    const int kSites = 3;
+    for (int round = 0; round < 50; ++round) {
+        std::string base = round % 2 == 1 ? RandomText(rng, 200) : "";
+        std::vector<std::unique_ptr<CRDTManager>> sites;
+        for (int s = 0; s < kSites; ++s) {
+            sites.push_back(std::make_unique<CRDTManager>("site" + std::to_string(s)));
+            sites[s]->Import(kDoc, base, kImportId);
+        }
+
+        // The log is causal: a site only generates ops after ones it has applied
+        std::vector<Op> log;
+        std::vector<std::vector<bool>> applied(kSites);
+        auto deliver = [&](int s) {
+            applied[s].resize(log.size(), false);
+            for (size_t i = 0; i < log.size(); ++i) {
+                if (applied[s][i]) continue;
+                Apply(*sites[s], log[i]);
+                applied[s][i] = true;
+            }
+        };
+
+        for (int step = 0; step < 400; ++step) {
+            int s = static_cast<int>(rng() % kSites);
+            if (rng() % 10 == 0) deliver(static_cast<int>(rng() % kSites));
+
+            applied[s].resize(log.size(), false);
+            std::vector<size_t> known_inserts;
+            for (size_t i = 0; i < log.size(); ++i) {
+                if (applied[s][i] && log[i].is_insert) known_inserts.push_back(i);
+            }
+
+            Op op;
+            if (!base.empty() && rng() % 8 == 0) {
+                op = {false, 0, {kImportId.site_id, kImportId.clock + static_cast<int32_t>(rng() % base.size())}, {}};
+                Apply(*sites[s], op);
+            } else if (!known_inserts.empty() && rng() % 4 == 0) {
+                op = {false, 0, log[known_inserts[rng() % known_inserts.size()]].id, {}};
+                Apply(*sites[s], op);
+            } else {
+                std::string text = sites[s]->GetText(kDoc);
+                auto insert = sites[s]->LocalInsert(kDoc, static_cast<int>(rng() % (text.size() + 1)),
+                                                    static_cast<char>('a' + rng() % 26));
+                op = {true, insert.content, insert.id, insert.origin_left};
+            }
+            log.push_back(op);
+            applied[s].push_back(true);
+        }
+
+        std::vector<std::string> texts;
+        for (int s = 0; s < kSites; ++s) {
+            deliver(s);
+            texts.push_back(sites[s]->GetText(kDoc));
+        }
+        for (int replica = 0; replica < 2; ++replica) {
+            CRDTManager fresh("replica");
+            ApplyShuffled(fresh, base, log, rng);
+            texts.push_back(fresh.GetText(kDoc));
+        }
+        for (const auto& text : texts) {
+            if (text != texts[0]) {
+                std::cerr << "convergence: replicas diverged in round " << round << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Reopen bookkeeping and clock exhaustion
+bool TestImportedRun() {
+    CRDTManager site("solo");
+    CharID first_id;
+    CRDTManager::ImportedRun run;
+    if (!site.ReserveIds(5, first_id) || !site.Import(kDoc, "hello", first_id, "v1") ||
+        !site.GetImportedRun(kDoc, run) || !(run.first_id == first_id) || run.length != 5 || run.source != "v1") {
+        std::cerr << "imported run: not recorded" << std::endl;
+        return false;
+    }
+    if (site.Import(kDoc, "hello", first_id, "v1")) {
+        std::cerr << "imported run: second import into a document with content" << std::endl;
+        return false;
+    }
+    site.LocalInsert(kDoc, 5, '!');
+    if (site.GetImportedRun(kDoc, run)) {
+        std::cerr << "imported run: still reported after an edit" << std::endl;
+        return false;
+    }
+
+    const int32_t max_clock = std::numeric_limits<int32_t>::max();
+    if (!site.ReserveIds(static_cast<size_t>(max_clock - first_id.clock - 5), first_id) || site.ReserveIds(1, first_id) ||
+        site.Import("other.txt", "ab", {"peer", max_clock})) {
+        std::cerr << "imported run: clock overflow not rejected" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Snapshots stay right as chunks and tree nodes split and empty out, and a
+// snapshot taken earlier is not affected by later edits
+bool TestSnapshots(std::mt19937& rng) {
+    CRDTManager site("solo");
+    std::string base(20000, ' ');
+    for (auto& c : base) c = static_cast<char>('a' + rng() % 26);
+    CharID first_id;
+    if (!site.ReserveIds(base.size(), first_id) || !site.Import(kDoc, base, first_id)) {
+        std::cerr << "snapshots: import failed" << std::endl;
+        return false;
+    }
+    auto imported = site.Snapshot(kDoc);
+
+    // Typing at one spot splits its chunk over and over, and then its parent
+    const size_t kTypedAt = 5000;
+    std::string typed(40000, ' ');
+    for (size_t i = 0; i < typed.size(); ++i) {
+        typed[i] = static_cast<char>('A' + rng() % 26);
+        site.LocalInsert(kDoc, static_cast<int>(kTypedAt + i), typed[i]);
+    }
+    std::string expected = base.substr(0, kTypedAt) + typed + base.substr(kTypedAt);
+    auto edited = site.Snapshot(kDoc);
+    if (edited->size() != expected.size() || edited->ToString() != expected) {
+        std::cerr << "snapshots: text differs after typing" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 200; ++i) {
+        size_t offset = rng() % (expected.size() + 10);
+        size_t length = rng() % 5000;
+        std::string window = offset < expected.size() ? expected.substr(offset, length) : "";
+        if (edited->Substr(offset, length) != window) {
+            std::cerr << "snapshots: window at " << offset << " differs" << std::endl;
+            return false;
+        }
+    }
+
+    // Deleting the imported text empties and drops its chunks
+    for (size_t i = 0; i < base.size(); ++i) {
+        site.ApplyDelete(kDoc, {first_id.site_id, first_id.clock + static_cast<int32_t>(i)});
+    }
+    for (size_t i = 0; i < typed.size(); i += 2) {
+        site.ApplyDelete(kDoc, {"solo", first_id.clock + static_cast<int32_t>(base.size() + i)});
+    }
+    std::string remaining;
+    for (size_t i = 1; i < typed.size(); i += 2) remaining += typed[i];
+    if (site.GetText(kDoc) != remaining) {
+        std::cerr << "snapshots: text differs after deletes" << std::endl;
+        return false;
+    }
+    for (size_t i = 1; i < typed.size(); i += 2) {
+        site.ApplyDelete(kDoc, {"solo", first_id.clock + static_cast<int32_t>(base.size() + i)});
+    }
+    if (site.Snapshot(kDoc)->size() != 0 || !site.GetText(kDoc).empty()) {
+        std::cerr << "snapshots: deleted document is not empty" << std::endl;
+        return false;
+    }
+
+    if (imported->ToString() != base || edited->ToString() != expected) {
+        std::cerr << "snapshots: an earlier snapshot changed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+} // namespace filesync
+
+int main() {
+    std::mt19937 rng(20261019);
+    bool ok = filesync::TestSingleSite(rng);
+    ok = filesync::TestConvergence(rng) && ok;
+    ok = filesync::TestImportedRun() && ok;
+    ok = filesync::TestSnapshots(rng) && ok;
+    std::cout << (ok ? "crdt_manager_test: OK" : "crdt_manager_test: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
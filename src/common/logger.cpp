@@ -0,0 +1,86 @@
+#include "logger.h"
+// Async leveled logger implementation
+#include <iostream>
+
+namespace filesync {
+
+Logger& Logger::Instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : writer_(&Logger::WriterLoop, this) {}
+
+Logger::~Logger() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_writer_.notify_one();
+    writer_.join();
+}
+
+bool Logger::ParseLevel(const std::string& text, LogLevel& level) {
+    if (text == "debug") level = LogLevel::Debug;
+    else if (text == "info") level = LogLevel::Info;
+    else if (text == "warning") level = LogLevel::Warning;
+    else if (text == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+void Logger::Log(LogLevel level, std::string message) {
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.size() >= kMaxPending) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        was_empty = pending_.empty();
+        pending_.push_back({level, std::move(message)});
+        enqueued_++;
+    }
+    // The writer drains the whole batch, so it only needs waking for the first entry.
+    if (was_empty) wake_writer_.notify_one();
+}
+
+void Logger::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = enqueued_;
+    flushed_.wait(lock, [&] { return written_ >= target; });
+}
+
+void Logger::WriterLoop() {
+    std::vector<Entry> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_writer_.wait(lock, [&] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty() && stopping_) break;
+
+        batch.swap(pending_);
+        lock.unlock();
+
+        bool wrote_stdout = false, wrote_stderr = false;
+        for (const auto& entry : batch) {
+            if (entry.level >= LogLevel::Warning) {
+                std::cerr << entry.message << '\n';
+                wrote_stderr = true;
+            } else {
+                std::cout << entry.message << '\n';
+                wrote_stdout = true;
+            }
+        }
+        if (wrote_stdout) std::cout.flush();
+        if (wrote_stderr) std::cerr.flush();
+
+        size_t count = batch.size();
+        batch.clear();
+
+        lock.lock();
+        written_ += count;
+        flushed_.notify_all();
+    }
+}
+
+} // namespace filesync
@@ -0,0 +1,81 @@
+#pragma once
+// Async leveled logger header
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace filesync {
+
+enum class LogLevel { Debug = 0, Info = 1, Warning = 2, Error = 3 };
+
+// Messages are formatted on the calling thread and handed to a background
+// writer thread, so request handlers never block on stdout/stderr. Warnings
+// and errors go to stderr, the rest to stdout. If the writer falls behind by
+// more than kMaxPending messages, new messages are dropped and counted.
+class Logger {
+public:
+    static Logger& Instance();
+
+    void SetLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    bool Enabled(LogLevel level) const { return static_cast<int>(level) >= level_.load(std::memory_order_relaxed); }
+
+    void Log(LogLevel level, std::string message);
+
+    // Block until everything queued so far has been written
+    void Flush();
+
+    int64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    // Parses debug|info|warning|error; returns false on anything else
+    static bool ParseLevel(const std::string& text, LogLevel& level);
+
+private:
+    Logger();
+    ~Logger();
+
+    void WriterLoop();
+
+    static constexpr size_t kMaxPending = 10000;
+
+    struct Entry {
+        LogLevel level;
+        std::string message;
+    };
+
+    std::atomic<int> level_{static_cast<int>(LogLevel::Info)};
+    std::atomic<int64_t> dropped_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wake_writer_;
+    std::condition_variable flushed_;
+    std::vector<Entry> pending_;
+    uint64_t enqueued_ = 0;
+    uint64_t written_ = 0;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+// Builds one log line and submits it on destruction
+class LogMessage {
+public:
+    explicit LogMessage(LogLevel level) : level_(level) {}
+    ~LogMessage() { Logger::Instance().Log(level_, stream_.str()); }
+    std::ostringstream& stream() { return stream_; }
+
+private:
+    LogLevel level_;
+    std::ostringstream stream_;
+};
+
+} // namespace filesync
+
+// FILESYNC_LOG(Info) << "text"; the message is not even formatted when the level is disabled.
+#define FILESYNC_LOG(level) \
+    if (!::filesync::Logger::Instance().Enabled(::filesync::LogLevel::level)) {} \
+    else ::filesync::LogMessage(::filesync::LogLevel::level).stream()
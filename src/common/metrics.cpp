@@ -0,0 +1,149 @@
+#include "metrics.h"
+// Metrics registry implementation
+#include <algorithm>
+#include <sstream>
+
+namespace filesync {
+
+namespace metrics {
+
+size_t ThreadShard() {
+    static std::atomic<size_t> next_shard{0};
+    thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return shard;
+}
+
+int64_t Counter::Value() const {
+    int64_t total = 0;
+    for (const auto& slot : shards_) {
+        total += slot.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t Histogram::BucketFor(int64_t value) {
+    if (value < 0) value = 0;
+    uint64_t v = static_cast<uint64_t>(value);
+    if (v < kLinearBuckets) return static_cast<size_t>(v);
+
+    int exponent = 63 - __builtin_clzll(v);
+    if (exponent > kMaxExponent) {
+        return kBuckets - 1;
+    }
+    size_t sub_bucket = (v >> (exponent - kSubBucketBits)) & ((size_t(1) << kSubBucketBits) - 1);
+    return kLinearBuckets + (exponent - kSubBucketBits - 1) * (size_t(1) << kSubBucketBits) + sub_bucket;
+}
+
+int64_t Histogram::BucketUpperBound(size_t bucket) {
+    if (bucket < kLinearBuckets) return static_cast<int64_t>(bucket);
+    size_t offset = bucket - kLinearBuckets;
+    int exponent = static_cast<int>(offset >> kSubBucketBits) + kSubBucketBits + 1;
+    int64_t sub_bucket = static_cast<int64_t>(offset & ((size_t(1) << kSubBucketBits) - 1));
+    int64_t base = int64_t(1) << kSubBucketBits;
+    return ((base + sub_bucket + 1) << (exponent - kSubBucketBits)) - 1;
+}
+
+void Histogram::Record(int64_t value) {
+    Slot& slot = shards_[ThreadShard() % kHistogramShards];
+    slot.buckets[BucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+    slot.count.fetch_add(1, std::memory_order_relaxed);
+    slot.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::Read() const {
+    Snapshot snapshot;
+    snapshot.buckets.assign(kBuckets, 0);
+    for (const auto& slot : shards_) {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            snapshot.buckets[i] += slot.buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.count += slot.count.load(std::memory_order_relaxed);
+        snapshot.sum += slot.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+int64_t Histogram::Snapshot::Quantile(double q) const {
+    int64_t total = 0;
+    for (int64_t bucket_count : buckets) total += bucket_count;
+    if (total == 0) return 0;
+
+    int64_t rank = std::max<int64_t>(1, static_cast<int64_t>(q * total + 0.5));
+    int64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return BucketUpperBound(i);
+    }
+    return BucketUpperBound(buckets.size() - 1);
+}
+
+Registry& Registry::Global() {
+    static Registry registry;
+    return registry;
+}
+
+Counter& Registry::GetCounter(const std::string& name, const std::string& help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& family = counters_[name];
+    family.help = help;
+    auto& series = family.series[labels];
+    if (!series) series = std::make_unique<Counter>();
+    return *series;
+}
+
+Histogram& Registry::GetHistogram(const std::string& name, const std::string& help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& family = histograms_[name];
+    family.help = help;
+    auto& series = family.series[labels];
+    if (!series) series = std::make_unique<Histogram>();
+    return *series;
+}
+
+std::string FormatSeries(const std::string& name, const Labels& labels) {
+    if (labels.empty()) return name;
+    std::string out = name + "{";
+    bool first = true;
+    for (const auto& [key, value] : labels) {
+        if (!first) out += ",";
+        out += key + "=\"" + value + "\"";
+        first = false;
+    }
+    return out + "}";
+}
+
+std::string Registry::RenderPrometheus() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ostringstream out;
+
+    for (const auto& [name, family] : counters_) {
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " counter\n";
+        for (const auto& [labels, counter] : family.series) {
+            out << FormatSeries(name, labels) << " " << counter->Value() << "\n";
+        }
+    }
+
+    const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (const auto& [name, family] : histograms_) {
+        out << "# HELP " << name << " " << family.help << "\n";
+        out << "# TYPE " << name << " summary\n";
+        for (const auto& [labels, histogram] : family.series) {
+            Histogram::Snapshot snapshot = histogram->Read();
+            for (double q : kQuantiles) {
+                Labels quantile_labels = labels;
+                std::ostringstream q_text;
+                q_text << q;
+                quantile_labels["quantile"] = q_text.str();
+                out << FormatSeries(name, quantile_labels) << " " << snapshot.Quantile(q) << "\n";
+            }
+            out << FormatSeries(name + "_sum", labels) << " " << snapshot.sum << "\n";
+            out << FormatSeries(name + "_count", labels) << " " << snapshot.count << "\n";
+        }
+    }
+    return out.str();
+}
+
+} // namespace metrics
+
+} // namespace filesync
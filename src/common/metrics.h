@@ -0,0 +1,122 @@
+#pragma once
+// Metrics registry header
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace filesync {
+
+namespace metrics {
+
+// Number of per-thread slots. Threads are assigned a slot round-robin, so with
+// up to kShards busy threads no two of them share a cache line.
+constexpr size_t kShards = 16;
+
+// Slot of the calling thread
+size_t ThreadShard();
+
+// Monotonic counter. Add() is a relaxed atomic add on the caller's own slot.
+class Counter {
+public:
+    void Add(int64_t value = 1) {
+        shards_[ThreadShard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+    int64_t Value() const;
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<int64_t> value{0};
+    };
+    std::array<Slot, kShards> shards_;
+};
+
+// HDR-style log-linear histogram: 8 linear sub-buckets per power of two, so any
+// recorded value is reported within 12.5%. Values are unitless (the metric name
+// carries the unit, e.g. _us).
+class Histogram {
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kMaxExponent = 40;
+    static constexpr size_t kLinearBuckets = size_t(1) << (kSubBucketBits + 1);
+    static constexpr size_t kBuckets = kLinearBuckets + (kMaxExponent - kSubBucketBits) * (size_t(1) << kSubBucketBits);
+
+    void Record(int64_t value);
+
+    struct Snapshot {
+        std::vector<int64_t> buckets;
+        int64_t count = 0;
+        int64_t sum = 0;
+
+        // Upper bound of the bucket holding the q-quantile
+        int64_t Quantile(double q) const;
+    };
+    Snapshot Read() const;
+
+    static size_t BucketFor(int64_t value);
+    static int64_t BucketUpperBound(size_t bucket);
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<int64_t> count{0};
+        std::atomic<int64_t> sum{0};
+        std::array<std::atomic<int64_t>, kBuckets> buckets{};
+    };
+    // Histograms are only touched on a few threads at a time; fewer slots than counters.
+    static constexpr size_t kHistogramShards = 8;
+    std::array<Slot, kHistogramShards> shards_;
+};
+
+using Labels = std::map<std::string, std::string>;
+
+// Process-wide registry. Lookups take a lock, so callers keep the returned
+// reference (e.g. in a function-local static) instead of looking up per event.
+class Registry {
+public:
+    static Registry& Global();
+
+    Counter& GetCounter(const std::string& name, const std::string& help, const Labels& labels = Labels());
+    Histogram& GetHistogram(const std::string& name, const std::string& help, const Labels& labels = Labels());
+
+    // Prometheus text exposition format. Histograms are exported as summaries.
+    std::string RenderPrometheus() const;
+
+private:
+    template <typename Metric>
+    struct Family {
+        std::string help;
+        std::map<Labels, std::unique_ptr<Metric>> series;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family<Counter>> counters_;
+    std::map<std::string, Family<Histogram>> histograms_;
+};
+
+// Records the elapsed time in microseconds into a histogram when destroyed
+class ScopedLatency {
+public:
+    explicit ScopedLatency(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency() {
+        histogram_.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Render "name{k="v",...}" for the exposition format
+std::string FormatSeries(const std::string& name, const Labels& labels);
+
+} // namespace metrics
+
+} // namespace filesync
@@ -0,0 +1,132 @@
+#include "tracing.h"
+// Phase-level tracing implementation
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <unistd.h>
+
+namespace filesync {
+
+namespace tracing {
+
+namespace {
+
+uint32_t CurrentThreadId() {
+    static std::atomic<uint32_t> next_thread_id{1};
+    thread_local uint32_t thread_id = next_thread_id.fetch_add(1, std::memory_order_relaxed);
+    return thread_id;
+}
+
+void AppendJsonString(std::ostringstream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out << ' ';
+                } else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+Tracer& Tracer::Global() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() : slots_(new Slot[kCapacity]) {
+    // Random start so ids from different processes are unlikely to collide
+    std::random_device rd;
+    next_trace_id_.store((static_cast<uint64_t>(rd()) << 32 | rd()) | 1, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::NewTraceId() {
+    uint64_t id = next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+    return id == 0 ? NewTraceId() : id;
+}
+
+void Tracer::Record(uint64_t trace_id, const char* name, const std::string& detail, int64_t start_us, int64_t duration_us) {
+    uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[index & (kCapacity - 1)];
+
+    // Odd sequence = write in progress
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.trace_id.store(trace_id, std::memory_order_relaxed);
+    slot.start_us.store(start_us, std::memory_order_relaxed);
+    slot.duration_us.store(duration_us, std::memory_order_relaxed);
+    slot.thread_id.store(CurrentThreadId(), std::memory_order_relaxed);
+
+    char packed[kDetailWords * sizeof(uint64_t)] = {};
+    std::memcpy(packed, detail.data(), std::min(detail.size(), sizeof(packed)));
+    for (size_t i = 0; i < kDetailWords; ++i) {
+        uint64_t word;
+        std::memcpy(&word, packed + i * sizeof(uint64_t), sizeof(word));
+        slot.detail[i].store(word, std::memory_order_relaxed);
+    }
+
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+std::string Tracer::DumpChromeJson(bool clear) {
+    uint64_t end = next_.load(std::memory_order_acquire);
+    uint64_t begin = std::max(floor_.load(std::memory_order_relaxed), end > kCapacity ? end - kCapacity : 0);
+    int pid = static_cast<int>(getpid());
+
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    for (uint64_t index = begin; index < end; ++index) {
+        const Slot& slot = slots_[index & (kCapacity - 1)];
+        uint64_t seq_before = slot.seq.load(std::memory_order_acquire);
+        if (seq_before != 2 * index + 2) continue; // Being written or already overwritten
+
+        const char* name = slot.name.load(std::memory_order_relaxed);
+        uint64_t trace_id = slot.trace_id.load(std::memory_order_relaxed);
+        int64_t start_us = slot.start_us.load(std::memory_order_relaxed);
+        int64_t duration_us = slot.duration_us.load(std::memory_order_relaxed);
+        uint32_t thread_id = slot.thread_id.load(std::memory_order_relaxed);
+        char packed[kDetailWords * sizeof(uint64_t) + 1] = {};
+        for (size_t i = 0; i < kDetailWords; ++i) {
+            uint64_t word = slot.detail[i].load(std::memory_order_relaxed);
+            std::memcpy(packed + i * sizeof(uint64_t), &word, sizeof(word));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq_before) continue;
+
+        std::string phase = name ? name : "";
+        out << (first ? "\n" : ",\n") << "  {\"name\": ";
+        AppendJsonString(out, phase);
+        // Category is the prefix before the first dot: "upload.sha256" -> "upload"
+        out << ", \"cat\": ";
+        AppendJsonString(out, phase.substr(0, phase.find('.')));
+        out << ", \"ph\": \"X\", \"ts\": " << start_us << ", \"dur\": " << duration_us;
+        out << ", \"pid\": " << pid << ", \"tid\": " << thread_id;
+        out << ", \"args\": {\"trace_id\": \"" << std::hex << trace_id << std::dec << "\", \"detail\": ";
+        AppendJsonString(out, packed);
+        out << "}}";
+        first = false;
+    }
+    out << "\n]}\n";
+
+    if (clear) {
+        floor_.store(end, std::memory_order_relaxed);
+    }
+    return out.str();
+}
+
+} // namespace tracing
+
+} // namespace filesync
@@ -0,0 +1,100 @@
+#pragma once
+// Phase-level tracing header
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace filesync {
+
+namespace tracing {
+
+// gRPC metadata key carrying the trace id of a traced request
+constexpr const char* kTraceMetadataKey = "x-filesync-trace-id";
+
+// Identifies one traced request. A zero id means "not traced": spans built from
+// it cost a single branch.
+struct TraceContext {
+    uint64_t trace_id = 0;
+    bool active() const { return trace_id != 0; }
+};
+
+// Process-wide span sink: a fixed-size ring of seqlock-protected slots. Writers
+// claim a slot with one atomic increment and never block; when the ring wraps the
+// oldest spans are overwritten. Readers skip slots that are mid-write.
+class Tracer {
+public:
+    static Tracer& Global();
+
+    // Trace every request, not only those that opt in through metadata
+    void SetEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    uint64_t NewTraceId();
+
+    void Record(uint64_t trace_id, const char* name, const std::string& detail, int64_t start_us, int64_t duration_us);
+
+    // Chrome/Perfetto trace JSON ({"traceEvents": [...]}); optionally forget the dumped spans
+    std::string DumpChromeJson(bool clear);
+
+private:
+    Tracer();
+
+    static constexpr size_t kCapacity = size_t(1) << 16; // Power of two
+    static constexpr size_t kDetailWords = 6;            // Up to 48 bytes of detail text
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> trace_id{0};
+        std::atomic<int64_t> start_us{0};
+        std::atomic<int64_t> duration_us{0};
+        std::atomic<uint32_t> thread_id{0};
+        std::array<std::atomic<uint64_t>, kDetailWords> detail{};
+    };
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<uint64_t> next_{0};
+    std::atomic<uint64_t> floor_{0};
+    std::atomic<uint64_t> next_trace_id_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+// Wall-clock microseconds, so client and server traces line up when merged
+inline int64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Records [construction, End()/destruction) as a complete event. `name` must be a
+// string literal; `detail` (e.g. a file name) is truncated to 48 bytes.
+class Span {
+public:
+    Span(const TraceContext& context, const char* name, const std::string& detail = std::string())
+        : trace_id_(context.trace_id), name_(name), start_us_(0) {
+        if (trace_id_ != 0) {
+            detail_ = detail;
+            start_us_ = NowMicros();
+        }
+    }
+    ~Span() { End(); }
+
+    void End() {
+        if (trace_id_ == 0) return;
+        Tracer::Global().Record(trace_id_, name_, detail_, start_us_, NowMicros() - start_us_);
+        trace_id_ = 0;
+    }
+
+private:
+    uint64_t trace_id_;
+    const char* name_;
+    std::string detail_;
+    int64_t start_us_;
+};
+
+} // namespace tracing
+
+} // namespace filesync
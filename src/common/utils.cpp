@@ -15,19 +15,30 @@ std::string CalculateSHA256(const std::string& file_path) {
         return "";
     }
 
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
+    SHA256Hasher hasher;
 
     const int buffer_size = 32768;
     std::vector<char> buffer(buffer_size);
 
     while (file.read(buffer.data(), buffer_size)) {
-        SHA256_Update(&sha256, buffer.data(), file.gcount());
+        hasher.Update(buffer.data(), file.gcount());
     }
-    SHA256_Update(&sha256, buffer.data(), file.gcount());
+    hasher.Update(buffer.data(), file.gcount());
 
+    return hasher.HexDigest();
+}
+
+SHA256Hasher::SHA256Hasher() {
+    SHA256_Init(&ctx_);
+}
+
+void SHA256Hasher::Update(const char* data, size_t length) {
+    SHA256_Update(&ctx_, data, length);
+}
+
+std::string SHA256Hasher::HexDigest() {
     unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_Final(hash, &sha256);
+    SHA256_Final(hash, &ctx_);
 
     std::stringstream ss;
     for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <cstdint>
+#include <openssl/sha.h>
 
 namespace filesync {
 
@@ -10,6 +11,18 @@ namespace utils {
 // Calculate SHA256 hash of a file
 std::string CalculateSHA256(const std::string& file_path);
 
+// Incremental SHA256 for data that arrives in pieces (e.g. streamed chunks)
+class SHA256Hasher {
+public:
+    SHA256Hasher();
+    void Update(const char* data, size_t length);
+    // Lowercase hex digest; the hasher must not be updated afterwards
+    std::string HexDigest();
+
+private:
+    SHA256_CTX ctx_;
+};
+
 // Get size of a file in bytes
 int64_t GetFileSize(const std::string& file_path);
 
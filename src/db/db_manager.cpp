@@ -1,9 +1,20 @@
 #include "db_manager.h"
 // Database management logic
-#include <iostream>
+#include <algorithm>
+#include "../common/logger.h"
+#include "../common/metrics.h"
 
 namespace filesync {
 
+namespace {
+
+metrics::Histogram& StatementLatency(const char* statement) {
+    return metrics::Registry::Global().GetHistogram(
+        "filesync_db_statement_latency_us", "SQLite statement latency in microseconds", {{"statement", statement}});
+}
+
+} // namespace
+
 DBManager::DBManager(const std::string& db_path) : db_path_(db_path), db_(nullptr) {}
 
 DBManager::~DBManager() {
@@ -15,7 +26,7 @@ DBManager::~DBManager() {
 bool DBManager::Init() {
     int rc = sqlite3_open(db_path_.c_str(), &db_);
     if (rc) {
-        std::cerr << "Can't open database: " << sqlite3_errmsg(db_) << std::endl;
+        FILESYNC_LOG(Error) << "Can't open database: " << sqlite3_errmsg(db_);
         return false;
     }
 
@@ -37,14 +48,38 @@ bool DBManager::Init() {
         );
     )";
 
-    return Execute(schema_sql);
+    if (!Execute(schema_sql)) return false;
+    return LoadCache();
+}
+
+bool DBManager::LoadCache() {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db_, "SELECT name, hash, size, timestamp FROM files WHERE is_deleted = 0;", -1, &stmt, 0) != SQLITE_OK) {
+        FILESYNC_LOG(Error) << "Failed to load file metadata: " << sqlite3_errmsg(db_);
+        return false;
+    }
+
+    std::vector<FileRecord> files;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        FileRecord file;
+        file.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        file.hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        file.size = sqlite3_column_int64(stmt, 2);
+        file.timestamp = sqlite3_column_int64(stmt, 3);
+        files.push_back(std::move(file));
+    }
+    sqlite3_finalize(stmt);
+
+    cache_.Put(files);
+    FILESYNC_LOG(Info) << "Loaded metadata for " << files.size() << " files";
+    return true;
 }
 
 bool DBManager::Execute(const std::string& sql) {
     char* zErrMsg = 0;
     int rc = sqlite3_exec(db_, sql.c_str(), 0, 0, &zErrMsg);
     if (rc != SQLITE_OK) {
-        std::cerr << "SQL error: " << zErrMsg << std::endl;
+        FILESYNC_LOG(Error) << "SQL error: " << zErrMsg;
         sqlite3_free(zErrMsg);
         return false;
     }
@@ -52,56 +87,93 @@ bool DBManager::Execute(const std::string& sql) {
 }
 
 bool DBManager::AddFile(const std::string& name, const std::string& hash, int64_t size, int64_t timestamp) {
+    static metrics::Histogram& latency = StatementLatency("add_file");
+    metrics::ScopedLatency timer(latency);
+    std::lock_guard<std::mutex> lock(write_mutex_);
     std::string sql = "INSERT OR REPLACE INTO files (name, version, hash, size, is_deleted, timestamp) VALUES ('" + 
                       name + "', 1, '" + hash + "', " + std::to_string(size) + ", 0, " + std::to_string(timestamp) + ");";
-    return Execute(sql);
+    if (!Execute(sql)) return false;
+    cache_.Put({{name, hash, size, timestamp}});
+    return true;
 }
 
 bool DBManager::GetFile(const std::string& name, std::string& hash, int64_t& size, int64_t& timestamp) {
-    std::string sql = "SELECT hash, size, timestamp FROM files WHERE name = '" + name + "';";
-    sqlite3_stmt* stmt;
-    
-    if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        return false;
-    }
-    
-    bool found = false;
-    if (sqlite3_step(stmt) == SQLITE_ROW) {
-        hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        size = sqlite3_column_int64(stmt, 1);
-        timestamp = sqlite3_column_int64(stmt, 2);
-        found = true;
-    }
-    
-    sqlite3_finalize(stmt);
-    return found;
+    FileRecord file;
+    if (!cache_.Get(name, file)) return false;
+    hash = file.hash;
+    size = file.size;
+    timestamp = file.timestamp;
+    return true;
 }
 
 std::vector<std::tuple<std::string, std::string, int64_t, int64_t>> DBManager::GetAllFiles() {
     std::vector<std::tuple<std::string, std::string, int64_t, int64_t>> files;
-    std::string sql = "SELECT name, hash, size, timestamp FROM files WHERE is_deleted = 0;";
-    sqlite3_stmt* stmt;
-    
-    if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, 0) != SQLITE_OK) {
-        return files;
-    }
-    
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::string name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-        std::string hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        int64_t size = sqlite3_column_int64(stmt, 2);
-        int64_t timestamp = sqlite3_column_int64(stmt, 3);
-        files.emplace_back(name, hash, size, timestamp);
-    }
-    
-    sqlite3_finalize(stmt);
+    files.reserve(cache_.size());
+    cache_.ForEach([&](const FileRecord& file) {
+        files.emplace_back(file.name, file.hash, file.size, file.timestamp);
+    });
+    // The cache is hashed; keep listings stable and in name order
+    std::sort(files.begin(), files.end());
     return files;
 }
 
 bool DBManager::AddChunk(const std::string& file_name, int32_t chunk_index, const std::string& node_id) {
+    static metrics::Histogram& latency = StatementLatency("add_chunk");
+    metrics::ScopedLatency timer(latency);
+    std::lock_guard<std::mutex> lock(write_mutex_);
     std::string sql = "INSERT OR REPLACE INTO chunks (file_name, chunk_index, node_id) VALUES ('" + 
                       file_name + "', " + std::to_string(chunk_index) + ", '" + node_id + "');";
     return Execute(sql);
 }
 
+bool DBManager::AddFiles(const std::vector<FileRecord>& files) {
+    static metrics::Histogram& latency = StatementLatency("add_files");
+    metrics::ScopedLatency timer(latency);
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    // One transaction and two prepared statements for the whole batch, instead of
+    // an implicit transaction (and a parse) per row
+    sqlite3_stmt* file_stmt = nullptr;
+    sqlite3_stmt* chunk_stmt = nullptr;
+    bool ok = Execute("BEGIN;") &&
+        sqlite3_prepare_v2(db_, "INSERT OR REPLACE INTO files (name, version, hash, size, is_deleted, timestamp) VALUES (?, 1, ?, ?, 0, ?);",
+                           -1, &file_stmt, 0) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, "INSERT OR REPLACE INTO chunks (file_name, chunk_index, node_id) VALUES (?, 0, ?);",
+                           -1, &chunk_stmt, 0) == SQLITE_OK;
+
+    for (size_t i = 0; ok && i < files.size(); ++i) {
+        const FileRecord& file = files[i];
+        sqlite3_bind_text(file_stmt, 1, file.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(file_stmt, 2, file.hash.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(file_stmt, 3, file.size);
+        sqlite3_bind_int64(file_stmt, 4, file.timestamp);
+        ok = sqlite3_step(file_stmt) == SQLITE_DONE;
+        sqlite3_reset(file_stmt);
+
+        for (const char* node_id : {"primary", "backup"}) {
+            if (!ok) break;
+            sqlite3_bind_text(chunk_stmt, 1, file.name.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(chunk_stmt, 2, node_id, -1, SQLITE_STATIC);
+            ok = sqlite3_step(chunk_stmt) == SQLITE_DONE;
+            sqlite3_reset(chunk_stmt);
+        }
+    }
+
+    if (!ok) {
+        FILESYNC_LOG(Error) << "Batch metadata insert failed: " << sqlite3_errmsg(db_);
+    }
+    sqlite3_finalize(file_stmt);
+    sqlite3_finalize(chunk_stmt);
+
+    if (ok) {
+        ok = Execute("COMMIT;");
+    }
+    if (!ok) {
+        Execute("ROLLBACK;");
+    } else {
+        cache_.Put(files);
+    }
+    return ok;
+}
+
 } // namespace filesync
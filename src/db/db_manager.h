@@ -5,6 +5,8 @@
 #include <sqlite3.h>
 #include <vector>
 #include <tuple>
+#include <mutex>
+#include "metadata_cache.h"
 
 namespace filesync {
 
@@ -16,15 +18,27 @@ public:
     bool Init();
     bool Execute(const std::string& sql);
     
-    // Metadata operations
+    // Metadata operations. Reads are served from the in-memory cache loaded by
+    // Init(); writes go to SQLite first and then to the cache.
     bool AddFile(const std::string& name, const std::string& hash, int64_t size, int64_t timestamp);
     bool GetFile(const std::string& name, std::string& hash, int64_t& size, int64_t& timestamp);
+    // Live files sorted by name
     std::vector<std::tuple<std::string, std::string, int64_t, int64_t>> GetAllFiles();
     bool AddChunk(const std::string& file_name, int32_t chunk_index, const std::string& node_id);
+    // Record many single-chunk files (and their primary/backup chunk rows) in one
+    // transaction; all or nothing.
+    bool AddFiles(const std::vector<FileRecord>& files);
 
 private:
+    bool LoadCache();
+
     std::string db_path_;
     sqlite3* db_;
+    // Live rows of `files`
+    MetadataCache cache_;
+    // Writes share one connection; serializing them keeps other threads' statements
+    // out of a batch transaction.
+    std::mutex write_mutex_;
 };
 
 } // namespace filesync
@@ -0,0 +1,46 @@
+#include "metadata_cache.h"
+// Metadata cache implementation
+#include <mutex>
+
+namespace filesync {
+
+MetadataCache::MetadataCache() : shards_(kShards) {}
+
+size_t MetadataCache::ShardIndex(const std::string& name) {
+    return std::hash<std::string>()(name) % kShards;
+}
+
+bool MetadataCache::Get(const std::string& name, FileRecord& file) const {
+    const Shard& shard = shards_[ShardIndex(name)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(name);
+    if (it == shard.entries.end()) return false;
+    file = it->second;
+    return true;
+}
+
+void MetadataCache::ForEach(const std::function<void(const FileRecord&)>& visit) const {
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto& entry : shard.entries) visit(entry.second);
+    }
+}
+
+size_t MetadataCache::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+void MetadataCache::Put(const std::vector<FileRecord>& files) {
+    for (const auto& file : files) {
+        Shard& shard = shards_[ShardIndex(file.name)];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.entries[file.name] = file;
+    }
+}
+
+} // namespace filesync
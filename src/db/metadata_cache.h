@@ -0,0 +1,50 @@
+#pragma once
+// Metadata cache header
+
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace filesync {
+
+struct FileRecord {
+    std::string name;
+    std::string hash;
+    int64_t size;
+    int64_t timestamp;
+};
+
+// In-memory copy of the `files` table.
+//
+// Entries are spread over kShards hash maps, each behind its own reader/writer
+// lock. A lookup holds one shard's shared lock for a single find, and a write
+// updates entries in place under that shard's exclusive lock, so readers only
+// ever wait on a writer touching the same ~250 entries and never on SQLite.
+class MetadataCache {
+public:
+    static constexpr size_t kShards = 4096; // ~250 entries per shard at 1M files
+
+    MetadataCache();
+
+    bool Get(const std::string& name, FileRecord& file) const;
+    // Visit every entry; each shard is seen as of one point in time
+    void ForEach(const std::function<void(const FileRecord&)>& visit) const;
+    size_t size() const;
+
+    // Insert or replace entries by name
+    void Put(const std::vector<FileRecord>& files);
+
+private:
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, FileRecord> entries;
+    };
+
+    static size_t ShardIndex(const std::string& name);
+
+    std::vector<Shard> shards_;
+};
+
+} // namespace filesync
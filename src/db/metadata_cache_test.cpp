@@ -0,0 +1,115 @@
+#include "metadata_cache.h"
+// Metadata cache and DBManager listing tests
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "db_manager.h"
+#include "../common/logger.h"
+
+namespace filesync {
+
+namespace {
+
+FileRecord File(int i, int64_t timestamp = 1000) {
+    return {"file-" + std::to_string(i), "hash-" + std::to_string(timestamp), i, timestamp};
+}
+
+// Puts insert and replace by name; Get and ForEach see the latest versions
+bool TestGetAndPut() {
+    MetadataCache cache;
+    std::vector<FileRecord> files;
+    for (int i = 0; i < 10000; ++i) files.push_back(File(i));
+    cache.Put(files);
+    cache.Put({File(42, 2000)});
+
+    FileRecord file;
+    bool ok = cache.size() == 10000 && cache.Get("file-42", file) && file.timestamp == 2000 && file.hash == "hash-2000" &&
+              cache.Get("file-7", file) && file.size == 7 && !cache.Get("missing", file);
+    int64_t visited = 0;
+    cache.ForEach([&](const FileRecord& entry) { visited += entry.size; });
+    ok = ok && visited == 9999LL * 10000 / 2;
+    if (!ok) {
+        std::cerr << "get and put: cache contents differ" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Readers running alongside a writer only ever see whole entries
+bool TestConcurrentReaders() {
+    MetadataCache cache;
+    const int kFiles = 1000;
+    std::vector<FileRecord> files;
+    for (int i = 0; i < kFiles; ++i) files.push_back(File(i, 0));
+    cache.Put(files);
+
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&, t] {
+            FileRecord file;
+            for (int i = t; !done; i = (i + 7) % kFiles) {
+                if (!cache.Get("file-" + std::to_string(i), file) || file.hash != "hash-" + std::to_string(file.timestamp)) {
+                    torn++;
+                }
+            }
+        });
+    }
+    for (int64_t version = 1; version <= 200; ++version) {
+        for (auto& file : files) file = File(static_cast<int>(file.size), version);
+        cache.Put(files);
+    }
+    done = true;
+    for (auto& reader : readers) reader.join();
+
+    FileRecord last;
+    if (torn != 0 || !cache.Get("file-0", last) || last.timestamp != 200 || cache.size() != kFiles) {
+        std::cerr << "concurrent readers: " << torn << " inconsistent reads" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// GetAllFiles lists live files in name order whatever order they were written in
+bool TestSortedListing() {
+    std::string path = "metadata_cache_test_" + std::to_string(getpid()) + ".db";
+    bool ok = false;
+    {
+        DBManager db(path);
+        if (db.Init()) {
+            std::vector<FileRecord> files;
+            for (int i = 500; i > 0; --i) files.push_back(File(i));
+            ok = db.AddFiles(files) && db.AddFile("a-first", "h", 1, 1) && db.AddFile("z-last", "h", 1, 1);
+            auto listed = db.GetAllFiles();
+            std::vector<std::string> names;
+            for (const auto& file : listed) names.push_back(std::get<0>(file));
+            ok = ok && names.size() == 502 && std::is_sorted(names.begin(), names.end()) && names.front() == "a-first" &&
+                 names.back() == "z-last";
+        }
+    }
+    std::remove(path.c_str());
+    if (!ok) {
+        std::cerr << "sorted listing: GetAllFiles is not in name order" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+} // namespace filesync
+
+int main() {
+    filesync::Logger::Instance().SetLevel(filesync::LogLevel::Warning);
+    bool ok = filesync::TestGetAndPut();
+    ok = filesync::TestConcurrentReaders() && ok;
+    ok = filesync::TestSortedListing() && ok;
+    std::cout << (ok ? "metadata_cache_test: OK" : "metadata_cache_test: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+#include "chunk_cache.h"
+// Hot-chunk cache implementation (S3-FIFO per shard)
+#include <algorithm>
+
+namespace filesync {
+
+namespace {
+
+// Saturating access counter ceiling used by S3-FIFO.
+constexpr uint8_t kMaxFreq = 3;
+
+// Share of each shard reserved for the small probationary queue.
+constexpr size_t kSmallQueuePercent = 10;
+
+// Lower bound on how many ghost keys a shard remembers.
+constexpr size_t kMinGhostEntries = 64;
+
+// Stale queue items a shard tolerates before compacting, beyond one per live entry.
+constexpr size_t kMinStaleItems = 64;
+
+} // namespace
+
+ChunkCache::ChunkCache(size_t capacity_bytes, size_t num_shards) {
+    num_shards = std::max<size_t>(num_shards, 1);
+    shard_capacity_ = capacity_bytes / num_shards;
+    small_capacity_ = shard_capacity_ * kSmallQueuePercent / 100;
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::string ChunkCache::MakeKey(const std::string& file_hash, int32_t chunk_index) {
+    return file_hash + ":" + std::to_string(chunk_index);
+}
+
+ChunkCache::Shard& ChunkCache::ShardFor(const std::string& key) {
+    return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+ChunkCache::ChunkData ChunkCache::GetOrLoad(const std::string& file_hash, int32_t chunk_index, const Loader& loader) {
+    std::string key = MakeKey(file_hash, chunk_index);
+    Shard& shard = ShardFor(key);
+
+    // Fast path: shared lock only, the access counter is bumped atomically.
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            Entry& entry = *it->second;
+            uint8_t freq = entry.freq.load(std::memory_order_relaxed);
+            if (freq < kMaxFreq) entry.freq.store(freq + 1, std::memory_order_relaxed);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            bytes_saved_.fetch_add(entry.data->size(), std::memory_order_relaxed);
+            return entry.data;
+        }
+    }
+
+    std::shared_ptr<InFlight> flight;
+    bool leader = false;
+    uint64_t epoch = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            // Filled by someone else between the two locks.
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            bytes_saved_.fetch_add(it->second->data->size(), std::memory_order_relaxed);
+            return it->second->data;
+        }
+
+        auto flight_it = shard.inflight.find(key);
+        if (flight_it != shard.inflight.end()) {
+            flight = flight_it->second;
+        } else {
+            flight = std::make_shared<InFlight>();
+            shard.inflight.emplace(key, flight);
+            leader = true;
+            epoch = shard.invalidation_epoch;
+        }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    if (!leader) {
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(flight->mutex);
+        flight->cv.wait(lock, [&flight] { return flight->done; });
+        if (flight->data) bytes_saved_.fetch_add(flight->data->size(), std::memory_order_relaxed);
+        return flight->data;
+    }
+
+    ChunkData data = loader();
+    if (data) bytes_loaded_.fetch_add(data->size(), std::memory_order_relaxed);
+
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto flight_it = shard.inflight.find(key);
+        if (flight_it != shard.inflight.end() && flight_it->second == flight) {
+            shard.inflight.erase(flight_it);
+        }
+        // Skip the insert if the file was invalidated while we were reading it.
+        if (data && shard.invalidation_epoch == epoch) {
+            Insert(shard, file_hash, chunk_index, key, data);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(flight->mutex);
+        flight->data = data;
+        flight->done = true;
+    }
+    flight->cv.notify_all();
+    return data;
+}
+
+void ChunkCache::InvalidateFile(const std::string& file_hash) {
+    std::string prefix = file_hash + ":";
+    for (auto& shard_ptr : shards_) {
+        Shard& shard = *shard_ptr;
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.invalidation_epoch++;
+
+        // New requests must not coalesce onto a load of the stale version.
+        for (auto it = shard.inflight.begin(); it != shard.inflight.end();) {
+            if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                it = shard.inflight.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto file_it = shard.by_file.find(file_hash);
+        if (file_it == shard.by_file.end()) continue;
+        std::vector<int32_t> indices(file_it->second.begin(), file_it->second.end());
+        for (int32_t chunk_index : indices) {
+            Remove(shard, MakeKey(file_hash, chunk_index));
+        }
+        // Their queue items stay behind; a shard under capacity never pops them
+        shard.stale_items += indices.size();
+        CompactQueues(shard);
+    }
+}
+
+void ChunkCache::Insert(Shard& shard, const std::string& file_hash, int32_t chunk_index, const std::string& key, ChunkData data) {
+    size_t size = data->size();
+    if (size > shard_capacity_) return;
+
+    auto entry = std::make_unique<Entry>();
+    entry->data = std::move(data);
+    entry->file_hash = file_hash;
+    entry->chunk_index = chunk_index;
+    entry->generation = shard.next_generation++;
+
+    // Keys we evicted recently from the small queue go straight to main.
+    auto ghost_it = shard.ghosts.find(key);
+    if (ghost_it != shard.ghosts.end()) {
+        shard.ghosts.erase(ghost_it);
+        entry->in_main = true;
+        shard.main_queue.push_back({key, entry->generation});
+        shard.main_bytes += size;
+    } else {
+        shard.small_queue.push_back({key, entry->generation});
+        shard.small_bytes += size;
+    }
+
+    shard.by_file[file_hash].insert(chunk_index);
+    shard.entries[key] = std::move(entry);
+    EvictIfNeeded(shard);
+}
+
+void ChunkCache::Remove(Shard& shard, const std::string& key) {
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) return;
+
+    Entry& entry = *it->second;
+    size_t size = entry.data->size();
+    if (entry.in_main) {
+        shard.main_bytes -= size;
+    } else {
+        shard.small_bytes -= size;
+    }
+
+    auto file_it = shard.by_file.find(entry.file_hash);
+    if (file_it != shard.by_file.end()) {
+        file_it->second.erase(entry.chunk_index);
+        if (file_it->second.empty()) shard.by_file.erase(file_it);
+    }
+
+    // Queue items pointing at this entry become stale and are skipped on pop.
+    shard.entries.erase(it);
+}
+
+void ChunkCache::EvictIfNeeded(Shard& shard) {
+    while (shard.small_bytes + shard.main_bytes > shard_capacity_) {
+        if (shard.small_queue.empty() && shard.main_queue.empty()) break;
+        if (shard.small_bytes > small_capacity_ || shard.main_queue.empty()) {
+            EvictFromSmall(shard);
+        } else {
+            EvictFromMain(shard);
+        }
+    }
+}
+
+void ChunkCache::EvictFromSmall(Shard& shard) {
+    while (!shard.small_queue.empty()) {
+        QueueItem item = std::move(shard.small_queue.front());
+        shard.small_queue.pop_front();
+
+        auto it = shard.entries.find(item.key);
+        if (it == shard.entries.end() || it->second->generation != item.generation || it->second->in_main) {
+            if (shard.stale_items > 0) shard.stale_items--;
+            continue; // Stale
+        }
+
+        Entry& entry = *it->second;
+        if (entry.freq.load(std::memory_order_relaxed) > 0) {
+            // Re-referenced while on probation: promote.
+            size_t size = entry.data->size();
+            entry.in_main = true;
+            entry.freq.store(0, std::memory_order_relaxed);
+            shard.small_bytes -= size;
+            shard.main_bytes += size;
+            shard.main_queue.push_back(std::move(item));
+            return;
+        }
+
+        Remove(shard, item.key);
+        RememberGhost(shard, item.key);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+void ChunkCache::EvictFromMain(Shard& shard) {
+    while (!shard.main_queue.empty()) {
+        QueueItem item = std::move(shard.main_queue.front());
+        shard.main_queue.pop_front();
+
+        auto it = shard.entries.find(item.key);
+        if (it == shard.entries.end() || it->second->generation != item.generation || !it->second->in_main) {
+            if (shard.stale_items > 0) shard.stale_items--;
+            continue; // Stale
+        }
+
+        Entry& entry = *it->second;
+        uint8_t freq = entry.freq.load(std::memory_order_relaxed);
+        if (freq > 0) {
+            // Second chance: reinsert at the tail with a lower count.
+            entry.freq.store(freq - 1, std::memory_order_relaxed);
+            shard.main_queue.push_back(std::move(item));
+            return;
+        }
+
+        Remove(shard, item.key);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+void ChunkCache::RememberGhost(Shard& shard, const std::string& key) {
+    if (!shard.ghosts.insert(key).second) return;
+    shard.ghost_queue.push_back(key);
+
+    size_t limit = std::max(shard.entries.size(), kMinGhostEntries);
+    while (shard.ghost_queue.size() > limit) {
+        shard.ghosts.erase(shard.ghost_queue.front());
+        shard.ghost_queue.pop_front();
+    }
+}
+
+void ChunkCache::CompactQueues(Shard& shard) {
+    if (shard.stale_items <= std::max(shard.entries.size(), kMinStaleItems)) return;
+    auto compact = [&shard](std::deque<QueueItem>& queue, bool in_main) {
+        std::deque<QueueItem> live;
+        for (auto& item : queue) {
+            auto it = shard.entries.find(item.key);
+            if (it != shard.entries.end() && it->second->generation == item.generation && it->second->in_main == in_main) {
+                live.push_back(std::move(item));
+            }
+        }
+        queue.swap(live);
+    };
+    compact(shard.small_queue, false);
+    compact(shard.main_queue, true);
+    shard.stale_items = 0;
+}
+
+ChunkCache::Stats ChunkCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+    stats.bytes_saved = bytes_saved_.load(std::memory_order_relaxed);
+    stats.bytes_loaded = bytes_loaded_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.capacity_bytes = static_cast<int64_t>(shard_capacity_ * shards_.size());
+    for (const auto& shard : shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        stats.bytes_used += static_cast<int64_t>(shard->small_bytes + shard->main_bytes);
+    }
+    return stats;
+}
+
+} // namespace filesync
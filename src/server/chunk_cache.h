@@ -0,0 +1,124 @@
+#pragma once
+// Hot-chunk cache header
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace filesync {
+
+// Sharded, size-bounded cache of file chunks keyed by (file hash, chunk index).
+//
+// Each shard runs S3-FIFO eviction: new chunks enter a small probationary FIFO
+// and are only promoted to the main FIFO if they are hit again before falling
+// out, so a one-off scan of a large file cannot flush the hot set. Keys evicted
+// from the small queue are remembered in a ghost list; a miss on a ghost key is
+// admitted straight into the main queue.
+//
+// Concurrent misses on the same key are coalesced: one caller runs the loader,
+// the others wait for its result.
+class ChunkCache {
+public:
+    using ChunkData = std::shared_ptr<const std::string>;
+    // Returns nullptr if the chunk could not be read.
+    using Loader = std::function<ChunkData()>;
+
+    struct Stats {
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t coalesced = 0;     // Misses that waited on another caller's load
+        int64_t bytes_saved = 0;   // Bytes served from memory instead of disk
+        int64_t bytes_loaded = 0;  // Bytes read from disk through the cache
+        int64_t evictions = 0;
+        int64_t bytes_used = 0;
+        int64_t capacity_bytes = 0;
+
+        double HitRatio() const {
+            int64_t total = hits + misses;
+            return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+        }
+    };
+
+    ChunkCache(size_t capacity_bytes, size_t num_shards = 16);
+
+    // Returns the cached chunk, or runs `loader` (once across concurrent callers) on a miss.
+    ChunkData GetOrLoad(const std::string& file_hash, int32_t chunk_index, const Loader& loader);
+
+    // Drop every cached chunk of a file version, and any load of it still in flight.
+    void InvalidateFile(const std::string& file_hash);
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        ChunkData data;
+        std::string file_hash;
+        int32_t chunk_index = 0;
+        std::atomic<uint8_t> freq{0};
+        bool in_main = false;
+        uint64_t generation = 0;
+    };
+
+    struct QueueItem {
+        std::string key;
+        uint64_t generation;
+    };
+
+    struct InFlight {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        ChunkData data;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+        std::unordered_map<std::string, std::unordered_set<int32_t>> by_file;
+        std::deque<QueueItem> small_queue;
+        std::deque<QueueItem> main_queue;
+        std::deque<std::string> ghost_queue;
+        std::unordered_set<std::string> ghosts;
+        std::unordered_map<std::string, std::shared_ptr<InFlight>> inflight;
+        size_t small_bytes = 0;
+        size_t main_bytes = 0;
+        size_t stale_items = 0; // Queue items whose entry was invalidated
+        uint64_t next_generation = 1;
+        uint64_t invalidation_epoch = 0;
+    };
+
+    static std::string MakeKey(const std::string& file_hash, int32_t chunk_index);
+    Shard& ShardFor(const std::string& key);
+
+    // All of the following require the shard's exclusive lock.
+    void Insert(Shard& shard, const std::string& file_hash, int32_t chunk_index, const std::string& key, ChunkData data);
+    void Remove(Shard& shard, const std::string& key);
+    void EvictIfNeeded(Shard& shard);
+    void EvictFromSmall(Shard& shard);
+    void EvictFromMain(Shard& shard);
+    void RememberGhost(Shard& shard, const std::string& key);
+    // Drop stale queue items once they outnumber the live entries
+    void CompactQueues(Shard& shard);
+
+    size_t shard_capacity_;
+    size_t small_capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<int64_t> hits_{0};
+    std::atomic<int64_t> misses_{0};
+    std::atomic<int64_t> coalesced_{0};
+    std::atomic<int64_t> bytes_saved_{0};
+    std::atomic<int64_t> bytes_loaded_{0};
+    std::atomic<int64_t> evictions_{0};
+};
+
+} // namespace filesync
@@ -0,0 +1,183 @@
+#include "chunk_cache.h"
+// S3-FIFO chunk cache tests
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace filesync {
+
+namespace {
+
+ChunkCache::Loader Load(const std::string& data, int& calls) {
+    return [&data, &calls]() -> ChunkCache::ChunkData {
+        calls++;
+        return std::make_shared<const std::string>(data);
+    };
+}
+
+// A second request for a chunk is served from memory
+bool TestHitAndMiss() {
+    ChunkCache cache(1024 * 1024, 1);
+    std::string data(100, 'a');
+    int calls = 0;
+    auto first = cache.GetOrLoad("h", 0, Load(data, calls));
+    auto second = cache.GetOrLoad("h", 0, Load(data, calls));
+    ChunkCache::Stats stats = cache.GetStats();
+    if (calls != 1 || !first || first != second || stats.hits != 1 || stats.misses != 1) {
+        std::cerr << "hit and miss: loader ran " << calls << " times" << std::endl;
+        return false;
+    }
+
+    // A failed load is not cached
+    auto failed = cache.GetOrLoad("h", 1, [] { return ChunkCache::ChunkData(); });
+    cache.GetOrLoad("h", 1, Load(data, calls));
+    if (failed || calls != 2) {
+        std::cerr << "hit and miss: failed load was cached" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Usage stays within capacity, and a hot set survives a one-off scan
+bool TestEvictionAndPromotion() {
+    const size_t kCapacity = 1000;
+    ChunkCache cache(kCapacity, 1);
+    std::string data(10, 'x');
+    int calls = 0;
+    for (int32_t hot = 0; hot < 5; ++hot) {
+        cache.GetOrLoad("hot", hot, Load(data, calls));
+        cache.GetOrLoad("hot", hot, Load(data, calls));
+    }
+    for (int32_t chunk = 0; chunk < 500; ++chunk) {
+        cache.GetOrLoad("scan", chunk, Load(data, calls));
+        if (cache.GetStats().bytes_used > static_cast<int64_t>(kCapacity)) {
+            std::cerr << "eviction: cache grew past its capacity" << std::endl;
+            return false;
+        }
+    }
+    if (cache.GetStats().evictions == 0) {
+        std::cerr << "eviction: nothing was evicted" << std::endl;
+        return false;
+    }
+
+    calls = 0;
+    for (int32_t hot = 0; hot < 5; ++hot) cache.GetOrLoad("hot", hot, Load(data, calls));
+    if (calls != 0) {
+        std::cerr << "promotion: " << calls << " hot chunks were flushed by a scan" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Concurrent misses on one key run the loader once
+bool TestCoalescing() {
+    ChunkCache cache(1024 * 1024, 1);
+    const int kThreads = 8;
+    std::atomic<int> calls{0};
+    std::atomic<int> started{0};
+    std::vector<ChunkCache::ChunkData> results(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            started++;
+            results[t] = cache.GetOrLoad("h", 0, [&]() -> ChunkCache::ChunkData {
+                calls++;
+                // Give the other threads time to pile up behind this load
+                while (started < kThreads) std::this_thread::yield();
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return std::make_shared<const std::string>("data");
+            });
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (const auto& result : results) {
+        if (!result || *result != "data") {
+            std::cerr << "coalescing: a caller got no data" << std::endl;
+            return false;
+        }
+    }
+    if (calls != 1) {
+        std::cerr << "coalescing: loader ran " << calls << " times" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A load that was in flight when its file was invalidated is not cached, and
+// later callers do not wait on it
+bool TestInvalidateDuringLoad() {
+    ChunkCache cache(1024 * 1024, 1);
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool loading = false;
+    bool release = false;
+
+    std::thread stale_reader([&] {
+        cache.GetOrLoad("h", 0, [&]() -> ChunkCache::ChunkData {
+            std::unique_lock<std::mutex> lock(mutex);
+            loading = true;
+            cv.notify_all();
+            cv.wait(lock, [&] { return release; });
+            return std::make_shared<const std::string>("old");
+        });
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return loading; });
+    }
+
+    cache.InvalidateFile("h");
+    int calls = 0;
+    std::string fresh = "new";
+    auto during = cache.GetOrLoad("h", 0, Load(fresh, calls));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+    stale_reader.join();
+
+    auto after = cache.GetOrLoad("h", 0, Load(fresh, calls));
+    if (!during || *during != "new" || !after || *after != "new" || calls != 1) {
+        std::cerr << "invalidation: stale in-flight load leaked into the cache" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Invalidated chunks are reloaded, and churn under capacity keeps working
+bool TestInvalidateFile() {
+    ChunkCache cache(1024 * 1024, 1);
+    std::string data(100, 'a');
+    int calls = 0;
+    for (int round = 0; round < 1000; ++round) {
+        for (int32_t chunk = 0; chunk < 4; ++chunk) cache.GetOrLoad("h", chunk, Load(data, calls));
+        cache.InvalidateFile("h");
+    }
+    if (calls != 4000 || cache.GetStats().bytes_used != 0) {
+        std::cerr << "invalidate file: chunks survived invalidation" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+} // namespace filesync
+
+int main() {
+    bool ok = filesync::TestHitAndMiss();
+    ok = filesync::TestEvictionAndPromotion() && ok;
+    ok = filesync::TestCoalescing() && ok;
+    ok = filesync::TestInvalidateDuringLoad() && ok;
+    ok = filesync::TestInvalidateFile() && ok;
+    std::cout << (ok ? "chunk_cache_test: OK" : "chunk_cache_test: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+#include "cluster.h"
+// Cluster replication implementation
+#include <algorithm>
+#include <chrono>
+#include "server.h"
+#include "../common/logger.h"
+#include "../common/metrics.h"
+
+namespace filesync {
+
+namespace {
+
+// Paths per GetMerkleNodes / GetBucketEntries call
+const int kMaxPathsPerRequest = 4096;
+const size_t kPathsPerCall = 1024;
+// Concurrent DownloadFile streams while pulling from one peer
+const size_t kPullThreads = 8;
+const int kMetadataDeadlineSeconds = 30;
+const int kDownloadDeadlineSeconds = 600;
+
+struct ClusterMetrics {
+    metrics::Counter& rounds;
+    metrics::Counter& unreachable;
+    metrics::Counter& buckets_differing;
+    metrics::Counter& files_pulled;
+    metrics::Counter& pull_failures;
+    metrics::Histogram& round_latency;
+};
+
+ClusterMetrics& Metrics() {
+    auto& registry = metrics::Registry::Global();
+    static ClusterMetrics cluster_metrics{
+        registry.GetCounter("filesync_cluster_rounds_total", "Anti-entropy rounds run against a peer"),
+        registry.GetCounter("filesync_cluster_unreachable_total", "Anti-entropy rounds that failed to reach the peer"),
+        registry.GetCounter("filesync_cluster_buckets_differing_total", "Merkle leaf buckets that differed from a peer"),
+        registry.GetCounter("filesync_cluster_files_pulled_total", "File versions pulled from peers"),
+        registry.GetCounter("filesync_cluster_pull_failures_total", "File versions that failed to pull from a peer"),
+        registry.GetHistogram("filesync_cluster_round_latency_us", "Anti-entropy round latency in microseconds"),
+    };
+    return cluster_metrics;
+}
+
+void SetDeadline(grpc::ClientContext& context, int seconds) {
+    context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(seconds));
+}
+
+} // namespace
+
+ClusterServiceImpl::ClusterServiceImpl(DBManager& db, const MerkleTree& merkle) : db_(db), merkle_(merkle) {}
+
+grpc::Status ClusterServiceImpl::GetMerkleNodes(grpc::ServerContext* context, const MerkleNodesRequest* request, MerkleNodesResponse* response) {
+    if (request->paths_size() > kMaxPathsPerRequest) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Too many paths");
+    }
+    std::vector<uint64_t> digests;
+    for (const auto& path : request->paths()) {
+        auto* node = response->add_nodes();
+        node->set_path(path);
+        if (merkle_.Children(path, digests)) {
+            for (uint64_t digest : digests) node->add_digests(digest);
+        }
+    }
+    response->set_root_digest(merkle_.RootDigest());
+    response->set_file_count(merkle_.size());
+    return grpc::Status::OK;
+}
+
+grpc::Status ClusterServiceImpl::GetBucketEntries(grpc::ServerContext* context, const BucketEntriesRequest* request, BucketEntriesResponse* response) {
+    if (request->paths_size() > kMaxPathsPerRequest) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Too many paths");
+    }
+    for (const auto& path : request->paths()) {
+        for (const auto& name : merkle_.BucketNames(path)) {
+            std::string hash;
+            int64_t size, timestamp;
+            if (!db_.GetFile(name, hash, size, timestamp)) continue;
+            auto* file = response->add_files();
+            file->set_file_name(name);
+            file->set_file_hash(hash);
+            file->set_file_size(size);
+            file->set_timestamp(timestamp);
+        }
+    }
+    return grpc::Status::OK;
+}
+
+AntiEntropy::AntiEntropy(FileSyncServiceImpl& files, const MerkleTree& merkle, const std::vector<std::string>& peers, int interval_ms)
+    : files_(files), merkle_(merkle), interval_ms_(interval_ms) {
+    for (const auto& address : peers) {
+        auto channel = grpc::CreateChannel(address, grpc::InsecureChannelCredentials());
+        peers_.push_back({address, ClusterService::NewStub(channel), FileSyncService::NewStub(channel)});
+    }
+}
+
+AntiEntropy::~AntiEntropy() {
+    Stop();
+}
+
+void AntiEntropy::Start() {
+    if (thread_.joinable() || peers_.empty()) return;
+    stopping_ = false;
+    thread_ = std::thread(&AntiEntropy::Run, this);
+}
+
+void AntiEntropy::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+    if (thread_.joinable()) thread_.join();
+}
+
+void AntiEntropy::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        for (size_t i = 0; i < peers_.size(); ++i) {
+            ReconcileWith(i);
+        }
+        lock.lock();
+        wakeup_.wait_for(lock, std::chrono::milliseconds(interval_ms_), [this] { return stopping_; });
+    }
+}
+
+int AntiEntropy::ReconcileWith(size_t peer_index) {
+    Peer& peer = peers_[peer_index];
+    metrics::ScopedLatency timer(Metrics().round_latency);
+    Metrics().rounds.Add();
+
+    // Descend level by level, keeping only the nodes whose digests differ
+    std::vector<std::string> frontier = {""};
+    std::vector<uint64_t> local;
+    for (int depth = 0; depth < MerkleTree::kDepth && !frontier.empty(); ++depth) {
+        std::vector<std::string> next;
+        for (size_t begin = 0; begin < frontier.size(); begin += kPathsPerCall) {
+            MerkleNodesRequest request;
+            for (size_t i = begin; i < std::min(frontier.size(), begin + kPathsPerCall); ++i) {
+                request.add_paths(frontier[i]);
+            }
+            MerkleNodesResponse response;
+            grpc::ClientContext context;
+            SetDeadline(context, kMetadataDeadlineSeconds);
+            grpc::Status status = peer.cluster->GetMerkleNodes(&context, request, &response);
+            if (!status.ok()) {
+                Metrics().unreachable.Add();
+                FILESYNC_LOG(Debug) << "Anti-entropy: peer " << peer.address << " unreachable: " << status.error_message();
+                return -1;
+            }
+            if (depth == 0 && response.root_digest() == merkle_.RootDigest()) return 0;
+
+            for (const auto& node : response.nodes()) {
+                if (!merkle_.Children(node.path(), local) || node.digests_size() != MerkleTree::kFanout) continue;
+                for (int child = 0; child < MerkleTree::kFanout; ++child) {
+                    if (node.digests(child) != local[child]) {
+                        next.push_back(node.path() + "0123456789abcdef"[child]);
+                    }
+                }
+            }
+        }
+        frontier = std::move(next);
+    }
+    Metrics().buckets_differing.Add(frontier.size());
+
+    // Compare entries of the differing buckets; keep the versions where the peer wins
+    std::vector<FileInfo> to_pull;
+    for (size_t begin = 0; begin < frontier.size(); begin += kPathsPerCall) {
+        BucketEntriesRequest request;
+        for (size_t i = begin; i < std::min(frontier.size(), begin + kPathsPerCall); ++i) {
+            request.add_paths(frontier[i]);
+        }
+        BucketEntriesResponse response;
+        grpc::ClientContext context;
+        SetDeadline(context, kMetadataDeadlineSeconds);
+        grpc::Status status = peer.cluster->GetBucketEntries(&context, request, &response);
+        if (!status.ok()) {
+            Metrics().unreachable.Add();
+            return -1;
+        }
+        for (const auto& file : response.files()) {
+            FileRecord record = {file.file_name(), file.file_hash(), file.file_size(), file.timestamp()};
+            uint64_t local_digest;
+            if (merkle_.Lookup(record.name, local_digest) && local_digest == MerkleTree::EntryDigest(record)) continue;
+            if (files_.SupersedesLocal(record)) to_pull.push_back(file);
+        }
+    }
+    if (to_pull.empty()) return 0;
+
+    std::atomic<size_t> next_file{0};
+    std::atomic<int> pulled{0};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < std::min(kPullThreads, to_pull.size()); ++t) {
+        workers.emplace_back([&]() {
+            for (size_t i = next_file++; i < to_pull.size(); i = next_file++) {
+                if (PullFile(peer, to_pull[i])) {
+                    pulled++;
+                } else {
+                    Metrics().pull_failures.Add();
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    Metrics().files_pulled.Add(pulled.load());
+    FILESYNC_LOG(Info) << "Anti-entropy: pulled " << pulled.load() << " of " << to_pull.size() << " files from " << peer.address
+                       << " (" << frontier.size() << " buckets differed)";
+    return pulled.load();
+}
+
+bool AntiEntropy::PullFile(Peer& peer, const FileInfo& info) {
+    FileRequest request;
+    request.set_file_name(info.file_name());
+    // The peer may have moved on since listing; only its listed version is wanted
+    request.set_expected_hash(info.file_hash());
+
+    grpc::ClientContext context;
+    SetDeadline(context, kDownloadDeadlineSeconds);
+    std::unique_ptr<grpc::ClientReader<FileChunk>> reader(peer.files->DownloadFile(&context, request));
+
+    FileChunk chunk;
+    FileRecord record = {info.file_name(), info.file_hash(), info.file_size(), info.timestamp()};
+    bool stored = files_.StoreReplica(record, [&](std::string& data) -> bool {
+        if (!reader->Read(&chunk)) return false;
+        data.swap(*chunk.mutable_data());
+        return true;
+    });
+    if (!stored) context.TryCancel();
+
+    grpc::Status status = reader->Finish();
+    if (!status.ok() && status.error_code() != grpc::StatusCode::CANCELLED) {
+        FILESYNC_LOG(Debug) << "Anti-entropy: failed to pull " << info.file_name() << " from " << peer.address << ": " << status.error_message();
+    }
+    return stored;
+}
+
+} // namespace filesync
@@ -0,0 +1,71 @@
+#pragma once
+// Cluster replication header
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "cluster.grpc.pb.h"
+#include "filesync.grpc.pb.h"
+#include "../db/db_manager.h"
+#include "merkle_tree.h"
+
+namespace filesync {
+
+class FileSyncServiceImpl;
+
+// Serves this node's Merkle tree and bucket contents to peers running anti-entropy
+class ClusterServiceImpl final : public ClusterService::Service {
+public:
+    ClusterServiceImpl(DBManager& db, const MerkleTree& merkle);
+
+    grpc::Status GetMerkleNodes(grpc::ServerContext* context, const MerkleNodesRequest* request, MerkleNodesResponse* response) override;
+    grpc::Status GetBucketEntries(grpc::ServerContext* context, const BucketEntriesRequest* request, BucketEntriesResponse* response) override;
+
+private:
+    DBManager& db_;
+    const MerkleTree& merkle_;
+};
+
+// Pull-based anti-entropy: every interval this node compares its Merkle tree with
+// each peer's, descending only into subtrees whose digests differ, and pulls the
+// file versions the peer has that win last-writer-wins (newer timestamp, then
+// larger hash). Since every node pulls from its peers, the cluster converges.
+class AntiEntropy {
+public:
+    AntiEntropy(FileSyncServiceImpl& files, const MerkleTree& merkle, const std::vector<std::string>& peers, int interval_ms);
+    ~AntiEntropy();
+
+    void Start();
+    void Stop();
+
+    // One reconciliation round against one peer. Returns the number of files
+    // pulled, or -1 if the peer could not be reached.
+    int ReconcileWith(size_t peer_index);
+
+private:
+    struct Peer {
+        std::string address;
+        std::unique_ptr<ClusterService::Stub> cluster;
+        std::unique_ptr<FileSyncService::Stub> files;
+    };
+
+    void Run();
+    bool PullFile(Peer& peer, const FileInfo& info);
+
+    FileSyncServiceImpl& files_;
+    const MerkleTree& merkle_;
+    std::vector<Peer> peers_;
+    int interval_ms_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace filesync
@@ -0,0 +1,369 @@
+#include "storage_engine.h"
+// io_uring storage engine (raw syscalls against the kernel UAPI, no liburing dependency)
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#endif
+
+namespace filesync {
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+namespace {
+
+const unsigned kRingEntries = 16;
+
+// One registered buffer per ring. Upload chunks are copied into it once and then
+// written to primary and backup with WRITE_FIXED, so the kernel does not have to
+// pin the user pages again for every write. Sized to the largest upload chunk
+// the client sends (ChunkSizer::kMaxChunkSize); bigger appends use plain WRITE.
+const size_t kRegisteredBufferSize = 1024 * 1024;
+
+// Rings kept around for reuse; extra rings created under bursts are torn down.
+const size_t kMaxIdleRings = 64;
+
+// Minimal single-threaded io_uring: the owner queues SQEs and then calls Run().
+class Ring {
+public:
+    ~Ring() {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool Init() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, kRingEntries, &params));
+        if (fd_ < 0) return false;
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) return false;
+        if (single_mmap) {
+            cq_ptr_ = sq_ptr_;
+        } else {
+            cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) return false;
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        char* sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        local_tail_ = *sq_tail_;
+
+        char* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        if (!SupportsRequiredOps()) return false;
+
+        // Registration can fail under a low RLIMIT_MEMLOCK; plain writes still work.
+        buffer_.resize(kRegisteredBufferSize);
+        iovec iov;
+        iov.iov_base = buffer_.data();
+        iov.iov_len = buffer_.size();
+        buffer_registered_ = syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+        return true;
+    }
+
+    // Returns nullptr if the submission queue is full.
+    io_uring_sqe* NextSqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (local_tail_ - head >= sq_entries_) return nullptr;
+        unsigned index = local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        local_tail_++;
+        queued_++;
+        return sqe;
+    }
+
+    // Submit all queued SQEs in one io_uring_enter and wait for their completions.
+    // Returns (user_data, result) pairs, or false if the ring itself failed.
+    bool Run(std::vector<std::pair<uint64_t, int>>& completions) {
+        completions.clear();
+        unsigned to_submit = queued_;
+        unsigned remaining = queued_;
+        queued_ = 0;
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+
+        while (remaining > 0) {
+            int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(ret));
+
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            while (head != tail && remaining > 0) {
+                const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+                completions.emplace_back(cqe.user_data, cqe.res);
+                head++;
+                remaining--;
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+
+    bool has_fixed_buffer() const { return buffer_registered_; }
+    char* fixed_buffer() { return buffer_.data(); }
+
+private:
+    bool SupportsRequiredOps() {
+        const unsigned kProbeOps = 64;
+        std::vector<char> storage(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op), 0);
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        // IORING_REGISTER_PROBE itself needs 5.6+, the same kernel that added OP_READ/OP_WRITE.
+        if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) return false;
+
+        for (unsigned op : {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_FSYNC}) {
+            if (op >= probe->ops_len || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    void* sq_ptr_ = MAP_FAILED;
+    void* cq_ptr_ = MAP_FAILED;
+    io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned local_tail_ = 0;
+    unsigned queued_ = 0;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    std::vector<char> buffer_;
+    bool buffer_registered_ = false;
+};
+
+class IoUringStorageEngine;
+
+class IoUringStorageFile : public StorageFile {
+public:
+    IoUringStorageFile(IoUringStorageEngine* engine, int fd) : engine_(engine), fd_(fd) {}
+    ~IoUringStorageFile() override { close(fd_); }
+
+    int64_t ReadAt(int64_t offset, char* buffer, size_t length) override;
+
+    IoUringStorageEngine* engine_;
+    int fd_;
+    int64_t write_offset_ = 0;
+};
+
+class IoUringStorageEngine : public StorageEngine {
+public:
+    const char* Name() const override { return "io_uring"; }
+
+    // Each operation borrows a ring exclusively, so gRPC handler threads never share one.
+    std::unique_ptr<Ring> AcquireRing() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            if (!idle_rings_.empty()) {
+                auto ring = std::move(idle_rings_.back());
+                idle_rings_.pop_back();
+                return ring;
+            }
+        }
+        auto ring = std::make_unique<Ring>();
+        if (!ring->Init()) return nullptr;
+        return ring;
+    }
+
+    void ReleaseRing(std::unique_ptr<Ring> ring) {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        if (idle_rings_.size() < kMaxIdleRings) idle_rings_.push_back(std::move(ring));
+    }
+
+    std::unique_ptr<StorageFile> OpenForRead(const std::string& path) override {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+        return std::make_unique<IoUringStorageFile>(this, fd);
+    }
+
+    std::unique_ptr<StorageFile> OpenForWrite(const std::string& path) override {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return nullptr;
+        return std::make_unique<IoUringStorageFile>(this, fd);
+    }
+
+    int64_t Read(int fd, int64_t offset, char* buffer, size_t length) {
+        auto ring = AcquireRing();
+        if (!ring) return -1;
+
+        int64_t total = 0;
+        std::vector<std::pair<uint64_t, int>> completions;
+        while (static_cast<size_t>(total) < length) {
+            io_uring_sqe* sqe = ring->NextSqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->off = offset + total;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer + total);
+            sqe->len = static_cast<uint32_t>(length - total);
+
+            if (!ring->Run(completions)) return -1; // Ring is dropped, not reused
+            if (completions.empty() || completions[0].second < 0) {
+                ReleaseRing(std::move(ring));
+                return -1;
+            }
+            if (completions[0].second == 0) break; // EOF
+            total += completions[0].second;
+        }
+        ReleaseRing(std::move(ring));
+        return total;
+    }
+
+    std::vector<bool> AppendAll(const std::vector<StorageFile*>& files, const char* data, size_t length) override {
+        std::vector<bool> ok(files.size(), true);
+        auto ring = AcquireRing();
+        if (!ring) return std::vector<bool>(files.size(), false);
+
+        const char* source = data;
+        bool fixed = ring->has_fixed_buffer() && length <= kRegisteredBufferSize;
+        if (fixed) {
+            std::memcpy(ring->fixed_buffer(), data, length);
+            source = ring->fixed_buffer();
+        }
+
+        // Every file gets its write in the same submission; short writes are resubmitted.
+        std::vector<size_t> written(files.size(), 0);
+        std::vector<std::pair<uint64_t, int>> completions;
+        while (true) {
+            bool queued = false;
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (!ok[i] || written[i] >= length) continue;
+                io_uring_sqe* sqe = ring->NextSqe();
+                if (!sqe) break;
+                auto* file = static_cast<IoUringStorageFile*>(files[i]);
+                sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe->fd = file->fd_;
+                sqe->off = file->write_offset_ + written[i];
+                sqe->addr = reinterpret_cast<uint64_t>(source + written[i]);
+                sqe->len = static_cast<uint32_t>(length - written[i]);
+                sqe->buf_index = 0;
+                sqe->user_data = i;
+                queued = true;
+            }
+            if (!queued) break;
+
+            if (!ring->Run(completions)) {
+                return std::vector<bool>(files.size(), false);
+            }
+            for (const auto& completion : completions) {
+                size_t i = completion.first;
+                if (completion.second <= 0) {
+                    ok[i] = false;
+                } else {
+                    written[i] += completion.second;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (ok[i]) static_cast<IoUringStorageFile*>(files[i])->write_offset_ += length;
+        }
+        ReleaseRing(std::move(ring));
+        return ok;
+    }
+
+    std::vector<bool> SyncAll(const std::vector<StorageFile*>& files) override {
+        std::vector<bool> ok(files.size(), false);
+        auto ring = AcquireRing();
+        if (!ring) return ok;
+
+        // More files than ring entries are synced over several submissions
+        std::vector<std::pair<uint64_t, int>> completions;
+        size_t next = 0;
+        while (next < files.size()) {
+            size_t queued = 0;
+            for (; next < files.size(); ++next, ++queued) {
+                io_uring_sqe* sqe = ring->NextSqe();
+                if (!sqe) break;
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = static_cast<IoUringStorageFile*>(files[next])->fd_;
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                sqe->user_data = next;
+            }
+            if (queued == 0) break;
+
+            if (!ring->Run(completions)) return ok;
+            for (const auto& completion : completions) {
+                ok[completion.first] = completion.second == 0;
+            }
+        }
+        ReleaseRing(std::move(ring));
+        return ok;
+    }
+
+private:
+    std::mutex pool_mutex_;
+    std::vector<std::unique_ptr<Ring>> idle_rings_;
+};
+
+int64_t IoUringStorageFile::ReadAt(int64_t offset, char* buffer, size_t length) {
+    return engine_->Read(fd_, offset, buffer, length);
+}
+
+} // namespace
+
+std::unique_ptr<StorageEngine> CreateIoUringStorageEngine() {
+    auto engine = std::make_unique<IoUringStorageEngine>();
+    // Probe once so unsupported kernels fall back at startup, not on the first upload.
+    auto ring = engine->AcquireRing();
+    if (!ring) return nullptr;
+    engine->ReleaseRing(std::move(ring));
+    return engine;
+}
+
+#else
+
+std::unique_ptr<StorageEngine> CreateIoUringStorageEngine() {
+    return nullptr;
+}
+
+#endif
+
+} // namespace filesync
@@ -1,11 +1,95 @@
 #include "server.h"
 // Server entry point
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "../common/logger.h"
+
+namespace {
+
+void PrintUsage() {
+    std::cerr << "Usage: ./filesync_server [--listen=<addr>] [--db=<path>] [--chunk-cache-mb=<n>]"
+              << " [--storage-engine=<auto|io_uring|stream>] [--log-level=<debug|info|warning|error>]"
+              << " [--peers=<host:port,...>] [--anti-entropy-ms=<n>]"
+              << " [--qos-slots=<n>] [--qos-weights=<m,s,b>] [--client-rate-mb=<n>] [--client-burst-mb=<n>]"
+              << " [--bulk-threshold-mb=<n>]" << std::endl;
+}
+
+} // namespace
 
 int main(int argc, char** argv) {
     std::string server_address("0.0.0.0:50051");
     std::string db_path("filesync.db");
-    
-    filesync::RunServer(server_address, db_path);
-    
+    filesync::ServerOptions options;
+
+    // Optional flags: --listen=<addr> --db=<path> --chunk-cache-mb=<n> --storage-engine=<auto|io_uring|stream>
+    //                 --log-level=<debug|info|warning|error> --peers=<host:port,...> --anti-entropy-ms=<n>
+    //                 --qos-slots=<n> --qos-weights=<m,s,b> --client-rate-mb=<n> --client-burst-mb=<n> --bulk-threshold-mb=<n>
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        try {
+            if (arg.rfind("--listen=", 0) == 0) {
+                server_address = arg.substr(9);
+            } else if (arg.rfind("--db=", 0) == 0) {
+                db_path = arg.substr(5);
+            } else if (arg.rfind("--chunk-cache-mb=", 0) == 0) {
+                options.chunk_cache_bytes = std::stoull(arg.substr(17)) * 1024 * 1024;
+            } else if (arg.rfind("--storage-engine=", 0) == 0) {
+                options.storage_engine = arg.substr(17);
+            } else if (arg.rfind("--peers=", 0) == 0) {
+                std::stringstream peers(arg.substr(8));
+                std::string peer;
+                while (std::getline(peers, peer, ',')) {
+                    if (!peer.empty()) options.peers.push_back(peer);
+                }
+            } else if (arg.rfind("--anti-entropy-ms=", 0) == 0) {
+                options.anti_entropy_interval_ms = std::stoi(arg.substr(18));
+            } else if (arg.rfind("--qos-slots=", 0) == 0) {
+                options.qos.slots = std::stoi(arg.substr(12));
+            } else if (arg.rfind("--qos-weights=", 0) == 0) {
+                std::stringstream weights(arg.substr(14));
+                std::string weight;
+                // Interactive requests bypass the queue and take no weight
+                size_t index = static_cast<size_t>(filesync::QosClass::kMetadata);
+                while (std::getline(weights, weight, ',') && index <= filesync::kQosClasses) {
+                    if (index < filesync::kQosClasses) options.qos.weights[index] = std::stoi(weight);
+                    index++;
+                }
+                if (index != filesync::kQosClasses) {
+                    std::cerr << "--qos-weights needs three weights: metadata,small,bulk" << std::endl;
+                    return 1;
+                }
+            } else if (arg.rfind("--client-rate-mb=", 0) == 0) {
+                options.qos.client_rate_bytes = static_cast<int64_t>(std::stod(arg.substr(17)) * 1024 * 1024);
+            } else if (arg.rfind("--client-burst-mb=", 0) == 0) {
+                options.qos.client_burst_bytes = static_cast<int64_t>(std::stod(arg.substr(18)) * 1024 * 1024);
+            } else if (arg.rfind("--bulk-threshold-mb=", 0) == 0) {
+                options.qos.bulk_threshold_bytes = static_cast<int64_t>(std::stod(arg.substr(20)) * 1024 * 1024);
+            } else if (arg.rfind("--log-level=", 0) == 0) {
+                filesync::LogLevel level;
+                if (!filesync::Logger::ParseLevel(arg.substr(12), level)) {
+                    std::cerr << "Invalid log level: " << arg.substr(12) << std::endl;
+                    return 1;
+                }
+                filesync::Logger::Instance().SetLevel(level);
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                PrintUsage();
+                return 1;
+            }
+        } catch (const std::logic_error&) {
+            // std::stoi and friends throw invalid_argument or out_of_range
+            std::cerr << "Invalid value: " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (options.qos.slots < 0 || options.anti_entropy_interval_ms <= 0 || options.qos.client_rate_bytes < 0) {
+        std::cerr << "--qos-slots and --client-rate-mb must not be negative, --anti-entropy-ms must be positive" << std::endl;
+        return 1;
+    }
+
+    filesync::RunServer(server_address, db_path, options);
+
     return 0;
 }
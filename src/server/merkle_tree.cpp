@@ -0,0 +1,157 @@
+#include "merkle_tree.h"
+// Merkle tree over file metadata implementation
+#include <algorithm>
+#include <mutex>
+
+namespace filesync {
+
+namespace {
+
+// FNV-1a with a splitmix64 finalizer: fast and identical on every node. Peers
+// are trusted, so the digest only has to catch accidental divergence.
+class Hash64 {
+public:
+    void Add(const std::string& text) {
+        for (unsigned char c : text) AddByte(c);
+        AddByte(0);
+    }
+    void Add(int64_t value) {
+        uint64_t bits = static_cast<uint64_t>(value);
+        for (int i = 0; i < 8; ++i) AddByte(static_cast<unsigned char>(bits >> (8 * i)));
+    }
+    uint64_t Finish() const {
+        uint64_t z = state_ + 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    void AddByte(unsigned char c) {
+        state_ ^= c;
+        state_ *= 0x100000001b3ULL;
+    }
+
+    uint64_t state_ = 0xcbf29ce484222325ULL;
+};
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+} // namespace
+
+MerkleTree::MerkleTree() : buckets_(size_t(1) << (4 * kDepth)) {
+    for (int depth = 0; depth <= kDepth; ++depth) {
+        levels_.emplace_back(size_t(1) << (4 * depth), 0);
+    }
+}
+
+uint64_t MerkleTree::EntryDigest(const FileRecord& file) {
+    Hash64 hash;
+    hash.Add(file.name);
+    hash.Add(file.hash);
+    hash.Add(file.size);
+    hash.Add(file.timestamp);
+    return hash.Finish();
+}
+
+uint32_t MerkleTree::BucketIndex(const std::string& name) {
+    Hash64 hash;
+    hash.Add(name);
+    return static_cast<uint32_t>(hash.Finish() >> (64 - 4 * kDepth));
+}
+
+std::string MerkleTree::BucketPath(const std::string& name) {
+    static const char* kHex = "0123456789abcdef";
+    uint32_t index = BucketIndex(name);
+    std::string path(kDepth, '0');
+    for (int i = kDepth - 1; i >= 0; --i) {
+        path[i] = kHex[index & 0xf];
+        index >>= 4;
+    }
+    return path;
+}
+
+int64_t MerkleTree::NodeIndex(const std::string& path) {
+    if (path.size() > static_cast<size_t>(kDepth)) return -1;
+    int64_t index = 0;
+    for (char c : path) {
+        int value = HexValue(c);
+        if (value < 0) return -1;
+        index = index * kFanout + value;
+    }
+    return index;
+}
+
+void MerkleTree::Update(const FileRecord& file) {
+    uint32_t bucket = BucketIndex(file.name);
+    uint64_t digest = EntryDigest(file);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto& entries = buckets_[bucket];
+    auto it = std::lower_bound(entries.begin(), entries.end(), file.name,
+                               [](const Entry& entry, const std::string& name) { return entry.name < name; });
+    uint64_t delta = digest;
+    if (it != entries.end() && it->name == file.name) {
+        delta ^= it->digest;
+        it->digest = digest;
+    } else {
+        entries.insert(it, {file.name, digest});
+        ++size_;
+    }
+
+    // XOR the change into the bucket and every ancestor up to the root
+    uint64_t index = bucket;
+    for (int depth = kDepth; depth >= 0; --depth) {
+        levels_[depth][index] ^= delta;
+        index /= kFanout;
+    }
+}
+
+bool MerkleTree::Lookup(const std::string& name, uint64_t& digest) const {
+    uint32_t bucket = BucketIndex(name);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto& entries = buckets_[bucket];
+    auto it = std::lower_bound(entries.begin(), entries.end(), name,
+                               [](const Entry& entry, const std::string& key) { return entry.name < key; });
+    if (it == entries.end() || it->name != name) return false;
+    digest = it->digest;
+    return true;
+}
+
+bool MerkleTree::Children(const std::string& path, std::vector<uint64_t>& digests) const {
+    int64_t index = NodeIndex(path);
+    if (index < 0 || path.size() >= static_cast<size_t>(kDepth)) return false;
+
+    const auto& level = levels_[path.size() + 1];
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    digests.assign(level.begin() + index * kFanout, level.begin() + (index + 1) * kFanout);
+    return true;
+}
+
+std::vector<std::string> MerkleTree::BucketNames(const std::string& path) const {
+    std::vector<std::string> names;
+    int64_t index = NodeIndex(path);
+    if (index < 0 || path.size() != static_cast<size_t>(kDepth)) return names;
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& entry : buckets_[index]) {
+        names.push_back(entry.name);
+    }
+    return names;
+}
+
+uint64_t MerkleTree::RootDigest() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return levels_[0][0];
+}
+
+size_t MerkleTree::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return size_;
+}
+
+} // namespace filesync
@@ -0,0 +1,68 @@
+#pragma once
+// Merkle tree over file metadata header
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../db/db_manager.h"
+
+namespace filesync {
+
+// Summary of the `files` table used by cluster anti-entropy.
+//
+// Every file entry (name, hash, size, timestamp) hashes to a 64-bit digest and
+// lives in one of 16^kDepth leaf buckets chosen by the hash of its name. A node's
+// digest is the XOR of every entry digest below it, so an AddFile touches one
+// path of kDepth + 1 nodes and two nodes holding the same entries have equal
+// digests regardless of insertion order.
+//
+// Nodes are addressed by paths of hex digits from the root: "" is the root,
+// "a" its 11th child, and a kDepth-digit path names a leaf bucket.
+class MerkleTree {
+public:
+    static constexpr int kDepth = 4; // 65536 leaf buckets, ~15 entries each at 1M files
+    static constexpr int kFanout = 16;
+
+    MerkleTree();
+
+    // Insert or replace the entry for file.name
+    void Update(const FileRecord& file);
+
+    // Digest of this node's entry for `name`; false if the file is unknown
+    bool Lookup(const std::string& name, uint64_t& digest) const;
+
+    // Digests of the kFanout children of an inner node; false if `path` is not an inner node
+    bool Children(const std::string& path, std::vector<uint64_t>& digests) const;
+
+    // Names in a leaf bucket
+    std::vector<std::string> BucketNames(const std::string& path) const;
+
+    uint64_t RootDigest() const;
+    size_t size() const;
+
+    static uint64_t EntryDigest(const FileRecord& file);
+    // Leaf bucket path of a file name
+    static std::string BucketPath(const std::string& name);
+
+private:
+    // Index of the node at `path` within its level, or -1 if the path is malformed
+    static int64_t NodeIndex(const std::string& path);
+    static uint32_t BucketIndex(const std::string& name);
+
+    struct Entry {
+        std::string name;
+        uint64_t digest;
+    };
+
+    mutable std::shared_mutex mutex_;
+    // levels_[d] holds the 16^d node digests of depth d; levels_[kDepth] are the buckets
+    std::vector<std::vector<uint64_t>> levels_;
+    // Entries of each leaf bucket, sorted by name; a handful per bucket, so a flat
+    // vector beats a hash map on memory and load time
+    std::vector<std::vector<Entry>> buckets_;
+    size_t size_ = 0;
+};
+
+} // namespace filesync
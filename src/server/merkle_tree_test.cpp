@@ -0,0 +1,160 @@
+#include "merkle_tree.h"
+// Merkle tree and anti-entropy diff tests
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace filesync {
+
+namespace {
+
+FileRecord File(int i, int64_t timestamp = 1000) {
+    return {"file-" + std::to_string(i) + ".txt", "hash-" + std::to_string(i), 100 + i, timestamp};
+}
+
+// Leaf buckets whose digests differ, found the way AntiEntropy::ReconcileWith
+// walks a peer: level by level, descending only into differing children
+std::vector<std::string> DifferingBuckets(const MerkleTree& local, const MerkleTree& remote) {
+    if (local.RootDigest() == remote.RootDigest()) return {};
+    std::vector<std::string> frontier = {""};
+    std::vector<uint64_t> local_digests;
+    std::vector<uint64_t> remote_digests;
+    for (int depth = 0; depth < MerkleTree::kDepth; ++depth) {
+        std::vector<std::string> next;
+        for (const auto& path : frontier) {
+            if (!local.Children(path, local_digests) || !remote.Children(path, remote_digests)) return {};
+            for (int child = 0; child < MerkleTree::kFanout; ++child) {
+                if (local_digests[child] != remote_digests[child]) next.push_back(path + "0123456789abcdef"[child]);
+            }
+        }
+        frontier = std::move(next);
+    }
+    return frontier;
+}
+
+// The same entries give the same digests whatever order they arrive in
+bool TestOrderIndependence() {
+    MerkleTree forward;
+    MerkleTree backward;
+    for (int i = 0; i < 1000; ++i) forward.Update(File(i));
+    for (int i = 999; i >= 0; --i) backward.Update(File(i));
+    if (forward.RootDigest() != backward.RootDigest() || forward.size() != 1000 || backward.size() != 1000) {
+        std::cerr << "order independence: digests differ" << std::endl;
+        return false;
+    }
+    if (forward.RootDigest() == MerkleTree().RootDigest()) {
+        std::cerr << "order independence: root digest did not change" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Replacing an entry swaps its digest in place; restoring it restores the root
+bool TestUpdateAndLookup() {
+    MerkleTree tree;
+    for (int i = 0; i < 100; ++i) tree.Update(File(i));
+    uint64_t root = tree.RootDigest();
+
+    FileRecord newer = File(7, 2000);
+    tree.Update(newer);
+    uint64_t digest = 0;
+    bool ok = tree.size() == 100 && tree.RootDigest() != root && tree.Lookup(newer.name, digest) &&
+              digest == MerkleTree::EntryDigest(newer);
+    tree.Update(File(7));
+    ok = ok && tree.RootDigest() == root && !tree.Lookup("missing.txt", digest);
+    if (!ok) {
+        std::cerr << "update and lookup: entry was not replaced" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Each inner node is the XOR of its children, and buckets list their names
+bool TestStructure() {
+    MerkleTree tree;
+    std::set<std::string> names;
+    for (int i = 0; i < 500; ++i) {
+        tree.Update(File(i));
+        names.insert(File(i).name);
+    }
+
+    std::vector<uint64_t> children;
+    if (!tree.Children("", children) || children.size() != MerkleTree::kFanout) {
+        std::cerr << "structure: root has no children" << std::endl;
+        return false;
+    }
+    uint64_t combined = 0;
+    for (uint64_t digest : children) combined ^= digest;
+    if (combined != tree.RootDigest()) {
+        std::cerr << "structure: root is not the XOR of its children" << std::endl;
+        return false;
+    }
+
+    // Every name sits in the bucket BucketPath names, in sorted order
+    for (const auto& name : names) {
+        auto bucket = tree.BucketNames(MerkleTree::BucketPath(name));
+        if (std::find(bucket.begin(), bucket.end(), name) == bucket.end() || !std::is_sorted(bucket.begin(), bucket.end())) {
+            std::cerr << "structure: " << name << " missing from its bucket" << std::endl;
+            return false;
+        }
+    }
+
+    // Malformed and leaf paths have no children; inner paths have no names
+    std::string leaf(MerkleTree::kDepth, '0');
+    bool ok = !tree.Children(leaf, children) && !tree.Children("g", children) && !tree.Children("A", children) &&
+              tree.BucketNames("0").empty() && tree.BucketNames(leaf + "0").empty();
+    if (!ok) {
+        std::cerr << "structure: malformed path accepted" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// The descent reaches exactly the buckets holding the entries that differ
+bool TestDiff() {
+    MerkleTree local;
+    MerkleTree remote;
+    for (int i = 0; i < 2000; ++i) {
+        local.Update(File(i));
+        remote.Update(File(i));
+    }
+    if (!DifferingBuckets(local, remote).empty()) {
+        std::cerr << "diff: identical trees differ" << std::endl;
+        return false;
+    }
+
+    // One newer version, one file only the remote has
+    remote.Update(File(42, 2000));
+    remote.Update(File(5000));
+    std::set<std::string> expected = {MerkleTree::BucketPath(File(42).name), MerkleTree::BucketPath(File(5000).name)};
+    auto differing = DifferingBuckets(local, remote);
+    std::set<std::string> found(differing.begin(), differing.end());
+    if (found != expected || differing.size() != expected.size()) {
+        std::cerr << "diff: found " << differing.size() << " buckets, expected " << expected.size() << std::endl;
+        return false;
+    }
+
+    // Applying the remote versions converges the trees
+    local.Update(File(42, 2000));
+    local.Update(File(5000));
+    if (local.RootDigest() != remote.RootDigest() || !DifferingBuckets(local, remote).empty()) {
+        std::cerr << "diff: trees did not converge" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+} // namespace filesync
+
+int main() {
+    bool ok = filesync::TestOrderIndependence();
+    ok = filesync::TestUpdateAndLookup() && ok;
+    ok = filesync::TestStructure() && ok;
+    ok = filesync::TestDiff() && ok;
+    std::cout << (ok ? "merkle_tree_test: OK" : "merkle_tree_test: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
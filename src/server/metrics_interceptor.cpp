@@ -0,0 +1,64 @@
+#include "metrics_interceptor.h"
+// Per-RPC metrics interceptor implementation
+#include <chrono>
+#include <unordered_map>
+#include "../common/metrics.h"
+
+namespace filesync {
+
+namespace {
+
+struct RpcMetrics {
+    metrics::Histogram* latency;
+    metrics::Counter* calls;
+    metrics::Counter* errors;
+};
+
+// info->method() is a stable pointer per registered method, so a thread-local
+// cache keyed by it avoids the registry lock after the first call on a thread.
+RpcMetrics MetricsFor(const char* method_path) {
+    thread_local std::unordered_map<const char*, RpcMetrics> cache;
+    auto it = cache.find(method_path);
+    if (it != cache.end()) return it->second;
+
+    // "/filesync.FileSyncService/UploadFile" -> "UploadFile"
+    std::string method = method_path;
+    size_t slash = method.find_last_of('/');
+    if (slash != std::string::npos) method = method.substr(slash + 1);
+
+    auto& registry = metrics::Registry::Global();
+    metrics::Labels labels = {{"method", method}};
+    RpcMetrics rpc_metrics;
+    rpc_metrics.latency = &registry.GetHistogram("filesync_rpc_latency_us", "RPC latency in microseconds", labels);
+    rpc_metrics.calls = &registry.GetCounter("filesync_rpc_calls_total", "RPCs handled", labels);
+    rpc_metrics.errors = &registry.GetCounter("filesync_rpc_errors_total", "RPCs that returned a non-OK status", labels);
+    return cache.emplace(method_path, rpc_metrics).first->second;
+}
+
+class MetricsInterceptor : public grpc::experimental::Interceptor {
+public:
+    explicit MetricsInterceptor(grpc::experimental::ServerRpcInfo* info)
+        : metrics_(MetricsFor(info->method())), start_(std::chrono::steady_clock::now()) {}
+
+    void Intercept(grpc::experimental::InterceptorBatchMethods* methods) override {
+        if (methods->QueryInterceptionHookPoint(grpc::experimental::InterceptionHookPoints::PRE_SEND_STATUS)) {
+            metrics_.latency->Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_).count());
+            metrics_.calls->Add();
+            if (!methods->GetSendStatus().ok()) metrics_.errors->Add();
+        }
+        methods->Proceed();
+    }
+
+private:
+    RpcMetrics metrics_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace
+
+grpc::experimental::Interceptor* MetricsInterceptorFactory::CreateServerInterceptor(grpc::experimental::ServerRpcInfo* info) {
+    return new MetricsInterceptor(info);
+}
+
+} // namespace filesync
@@ -0,0 +1,16 @@
+#pragma once
+// Per-RPC metrics interceptor header
+
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/support/server_interceptor.h>
+
+namespace filesync {
+
+// Records latency, call count and non-OK statuses for every RPC on the server,
+// labelled by method name (e.g. method="UploadFile").
+class MetricsInterceptorFactory : public grpc::experimental::ServerInterceptorFactoryInterface {
+public:
+    grpc::experimental::Interceptor* CreateServerInterceptor(grpc::experimental::ServerRpcInfo* info) override;
+};
+
+} // namespace filesync
@@ -0,0 +1,219 @@
+#include "qos_scheduler.h"
+// QoS scheduler implementation
+#include <algorithm>
+#include <thread>
+#include "../common/metrics.h"
+
+namespace filesync {
+
+namespace {
+
+// Fair-queuing cost unit: a 1 MB chunk costs 17 units, an empty request 1
+const int64_t kCostUnitBytes = 64 * 1024;
+// Idle (full) buckets are dropped once this many clients are tracked
+const size_t kMaxBuckets = 4096;
+
+struct QosMetrics {
+    metrics::Counter* admitted[kQosClasses];
+    metrics::Counter* bytes[kQosClasses];
+    metrics::Counter* throttled[kQosClasses];
+    metrics::Histogram* queue_wait[kQosClasses];
+    metrics::Histogram* throttle_wait[kQosClasses];
+};
+
+QosMetrics& Metrics() {
+    static QosMetrics qos_metrics = [] {
+        auto& registry = metrics::Registry::Global();
+        QosMetrics m;
+        for (size_t i = 0; i < kQosClasses; ++i) {
+            metrics::Labels labels = {{"class", QosClassName(static_cast<QosClass>(i))}};
+            m.admitted[i] = &registry.GetCounter("filesync_qos_admitted_total", "Requests admitted by the QoS scheduler", labels);
+            m.bytes[i] = &registry.GetCounter("filesync_qos_bytes_total", "Transfer bytes admitted by the QoS scheduler", labels);
+            m.throttled[i] = &registry.GetCounter("filesync_qos_throttled_total", "Admissions delayed by a per-client bandwidth limit", labels);
+            m.queue_wait[i] = &registry.GetHistogram("filesync_qos_queue_wait_us", "Time waiting for a QoS slot in microseconds", labels);
+            m.throttle_wait[i] = &registry.GetHistogram("filesync_qos_throttle_wait_us", "Time delayed by a per-client bandwidth limit in microseconds", labels);
+        }
+        return m;
+    }();
+    return qos_metrics;
+}
+
+int64_t Micros(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+} // namespace
+
+const char* QosClassName(QosClass cls) {
+    switch (cls) {
+        case QosClass::kInteractive: return "interactive";
+        case QosClass::kMetadata: return "metadata";
+        case QosClass::kSmallTransfer: return "small_transfer";
+        case QosClass::kBulkTransfer: return "bulk_transfer";
+    }
+    return "unknown";
+}
+
+QosScheduler::Ticket& QosScheduler::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        Release();
+        scheduler_ = other.scheduler_;
+        cls_ = other.cls_;
+        other.scheduler_ = nullptr;
+    }
+    return *this;
+}
+
+void QosScheduler::Ticket::Release() {
+    if (scheduler_) {
+        scheduler_->Release(cls_);
+        scheduler_ = nullptr;
+    }
+}
+
+QosScheduler::QosScheduler(const QosOptions& options)
+    : options_(options), bulk_slots_(std::max(1, options.slots / 4)) {
+    options_.weights[static_cast<size_t>(QosClass::kInteractive)] = 0;
+    for (size_t i = static_cast<size_t>(QosClass::kMetadata); i < kQosClasses; ++i) {
+        options_.weights[i] = std::max(options_.weights[i], 1);
+    }
+    options_.client_burst_bytes = std::max<int64_t>(options_.client_burst_bytes, 1);
+}
+
+QosClass QosScheduler::TransferClass(int64_t size) const {
+    return size >= options_.bulk_threshold_bytes ? QosClass::kBulkTransfer : QosClass::kSmallTransfer;
+}
+
+QosScheduler::Ticket QosScheduler::Admit(QosClass cls, const std::string& client, int64_t bytes) {
+    size_t index = static_cast<size_t>(cls);
+    QosMetrics& qos_metrics = Metrics();
+
+    // Throttle before queuing, so a client over its rate does not hold a slot.
+    // Interactive requests are not charged: they cannot be delayed, and debt they
+    // ran up would only hold back the same client's transfers.
+    if (options_.client_rate_bytes > 0 && bytes > 0 && cls != QosClass::kInteractive) {
+        Clock::duration delay = Charge(client, bytes);
+        if (delay > Clock::duration::zero()) {
+            std::this_thread::sleep_for(delay);
+            qos_metrics.throttled[index]->Add();
+            qos_metrics.throttle_wait[index]->Record(Micros(delay));
+            classes_[index].throttled++;
+            classes_[index].throttle_wait_us += Micros(delay);
+        }
+    }
+
+    ClassState& state = classes_[index];
+    Clock::time_point queued = Clock::now();
+    if (cls == QosClass::kInteractive) {
+        state.active++;
+    } else {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Waiter waiter{std::max(virtual_time_, state.finish_tag)};
+        state.finish_tag = waiter.start_tag + static_cast<double>(bytes / kCostUnitBytes + 1) / options_.weights[index];
+        state.queue.push_back(&waiter);
+        DispatchLocked();
+        cv_.wait(lock, [&] { return waiter.granted; });
+    }
+    state.admitted++;
+    state.bytes += bytes;
+    qos_metrics.queue_wait[index]->Record(Micros(Clock::now() - queued));
+    qos_metrics.admitted[index]->Add();
+    qos_metrics.bytes[index]->Add(bytes);
+    return Ticket(this, cls);
+}
+
+QosScheduler::Clock::duration QosScheduler::Charge(const std::string& client, int64_t bytes) {
+    double rate = static_cast<double>(options_.client_rate_bytes);
+    double burst = static_cast<double>(options_.client_burst_bytes);
+    Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(buckets_mutex_);
+    if (buckets_.size() >= kMaxBuckets) {
+        for (auto it = buckets_.begin(); it != buckets_.end();) {
+            double idle = std::chrono::duration<double>(now - it->second.refilled).count();
+            it = it->second.tokens + idle * rate >= burst ? buckets_.erase(it) : std::next(it);
+        }
+    }
+
+    auto inserted = buckets_.emplace(client, Bucket{burst, now});
+    Bucket& bucket = inserted.first->second;
+    double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+    bucket.tokens = std::min(burst, bucket.tokens + elapsed * rate);
+    bucket.refilled = now;
+    // The bucket may go into debt; later requests from the client wait it out in turn
+    bucket.tokens -= static_cast<double>(bytes);
+    if (bucket.tokens >= 0) return Clock::duration::zero();
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-bucket.tokens / rate));
+}
+
+bool QosScheduler::CanRunLocked(QosClass cls) const {
+    if (options_.slots <= 0) return true;
+    int free_slots = options_.slots - active_;
+    // Transfers leave the last slot to metadata, unless no metadata request is waiting
+    bool transfer_slot = free_slots > 1 ||
+                         (free_slots > 0 && classes_[static_cast<size_t>(QosClass::kMetadata)].queue.empty());
+    switch (cls) {
+        case QosClass::kInteractive: return true; // Not queued
+        case QosClass::kMetadata: return free_slots > 0;
+        case QosClass::kSmallTransfer: return transfer_slot;
+        case QosClass::kBulkTransfer:
+            return transfer_slot && classes_[static_cast<size_t>(QosClass::kBulkTransfer)].active < bulk_slots_;
+    }
+    return false;
+}
+
+void QosScheduler::DispatchLocked() {
+    bool granted = false;
+    while (true) {
+        ClassState* next = nullptr;
+        for (size_t i = 0; i < kQosClasses; ++i) {
+            ClassState& state = classes_[i];
+            if (state.queue.empty() || !CanRunLocked(static_cast<QosClass>(i))) continue;
+            if (!next || state.queue.front()->start_tag < next->queue.front()->start_tag) next = &state;
+        }
+        if (!next) break;
+
+        Waiter* waiter = next->queue.front();
+        next->queue.pop_front();
+        waiter->granted = true;
+        virtual_time_ = std::max(virtual_time_, waiter->start_tag);
+        next->active++;
+        active_++;
+        granted = true;
+    }
+    if (granted) cv_.notify_all();
+}
+
+void QosScheduler::Release(QosClass cls) {
+    classes_[static_cast<size_t>(cls)].active--;
+    if (cls == QosClass::kInteractive) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_--;
+    DispatchLocked();
+}
+
+std::vector<QosScheduler::ClassStats> QosScheduler::GetStats() const {
+    std::vector<ClassStats> stats;
+    for (size_t i = 0; i < kQosClasses; ++i) {
+        const ClassState& state = classes_[i];
+        ClassStats class_stats;
+        class_stats.cls = static_cast<QosClass>(i);
+        class_stats.weight = options_.weights[i];
+        class_stats.admitted = state.admitted;
+        class_stats.bytes = state.bytes;
+        class_stats.active = state.active;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            class_stats.queued = static_cast<int64_t>(state.queue.size());
+        }
+        class_stats.throttled = state.throttled;
+        class_stats.throttle_wait_us = state.throttle_wait_us;
+        metrics::Histogram::Snapshot wait = Metrics().queue_wait[i]->Read();
+        class_stats.queue_wait_p50_us = wait.Quantile(0.5);
+        class_stats.queue_wait_p99_us = wait.Quantile(0.99);
+        stats.push_back(class_stats);
+    }
+    return stats;
+}
+
+} // namespace filesync
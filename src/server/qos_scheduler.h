@@ -0,0 +1,137 @@
+#pragma once
+// QoS scheduler header
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace filesync {
+
+// Request classes, in priority order
+enum class QosClass { kInteractive = 0, kMetadata, kSmallTransfer, kBulkTransfer };
+constexpr size_t kQosClasses = 4;
+
+const char* QosClassName(QosClass cls);
+
+struct QosOptions {
+    // Metadata and transfer requests doing work at once; 0 disables queuing
+    int slots = std::max(4, 2 * static_cast<int>(std::thread::hardware_concurrency()));
+    // Fair-queuing share per class; interactive requests are never queued, so theirs is unused
+    std::array<int, kQosClasses> weights = {{0, 4, 2, 1}};
+    int64_t client_rate_bytes = 0;                 // Per-client bytes/s; 0 is unlimited
+    int64_t client_burst_bytes = 8 * 1024 * 1024;  // Token bucket depth
+    int64_t bulk_threshold_bytes = 8 * 1024 * 1024; // Transfers at least this large are bulk
+};
+
+// Admission control for server work.
+//
+// At most `slots` requests hold a ticket at a time. Waiting requests are ordered
+// by start-time fair queuing across classes: a request's virtual start is the
+// later of the current virtual time and its class's last finish tag, and each
+// admission pushes the class's finish tag forward by cost / weight. A backlog
+// of bulk chunks therefore only gets its weighted share. Bulk transfers hold at
+// most a quarter of the slots, and transfers only take the last slot while no
+// metadata request is waiting for it. Interactive requests (in-memory CRDT work)
+// are counted but bypass the queue and its lock, so edits are never held up by
+// transfers.
+//
+// Transfer bytes are also charged to a per-client token bucket. A client over
+// its rate sleeps before it queues for a slot. Interactive requests are neither
+// charged nor delayed.
+class QosScheduler {
+public:
+    // Holds a slot until destroyed
+    class Ticket {
+    public:
+        Ticket() = default;
+        explicit Ticket(QosScheduler* scheduler, QosClass cls) : scheduler_(scheduler), cls_(cls) {}
+        Ticket(Ticket&& other) noexcept : scheduler_(other.scheduler_), cls_(other.cls_) { other.scheduler_ = nullptr; }
+        Ticket& operator=(Ticket&& other) noexcept;
+        ~Ticket() { Release(); }
+
+        void Release();
+
+    private:
+        QosScheduler* scheduler_ = nullptr;
+        QosClass cls_ = QosClass::kInteractive;
+    };
+
+    struct ClassStats {
+        QosClass cls;
+        int weight = 0;
+        int64_t admitted = 0;
+        int64_t bytes = 0;
+        int64_t active = 0;
+        int64_t queued = 0;
+        int64_t throttled = 0;         // Admissions delayed by the client's token bucket
+        int64_t throttle_wait_us = 0;  // Total time spent in those delays
+        int64_t queue_wait_p50_us = 0;
+        int64_t queue_wait_p99_us = 0;
+    };
+
+    explicit QosScheduler(const QosOptions& options = QosOptions());
+
+    // Wait for the client's bandwidth and a slot for `bytes` of work of class `cls`.
+    // `client` identifies the caller for rate limiting (e.g. its address).
+    Ticket Admit(QosClass cls, const std::string& client, int64_t bytes);
+
+    // Class of a transfer of `size` bytes
+    QosClass TransferClass(int64_t size) const;
+
+    const QosOptions& options() const { return options_; }
+    std::vector<ClassStats> GetStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Waiter {
+        double start_tag;
+        bool granted = false;
+    };
+
+    // Counters are atomic so the interactive path can skip mutex_
+    struct ClassState {
+        std::deque<Waiter*> queue;
+        double finish_tag = 0;
+        std::atomic<int64_t> active{0};
+        std::atomic<int64_t> admitted{0};
+        std::atomic<int64_t> bytes{0};
+        std::atomic<int64_t> throttled{0};
+        std::atomic<int64_t> throttle_wait_us{0};
+    };
+
+    struct Bucket {
+        double tokens;
+        Clock::time_point refilled;
+    };
+
+    // Charge `bytes` to the client's bucket; returns how long the caller must wait
+    Clock::duration Charge(const std::string& client, int64_t bytes);
+    // Grant free slots to queued requests in start-tag order; requires mutex_
+    void DispatchLocked();
+    bool CanRunLocked(QosClass cls) const;
+    void Release(QosClass cls);
+
+    QosOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::array<ClassState, kQosClasses> classes_;
+    double virtual_time_ = 0;
+    int active_ = 0; // Slots held; interactive tickets do not hold one
+    int bulk_slots_;
+
+    std::mutex buckets_mutex_;
+    std::unordered_map<std::string, Bucket> buckets_;
+};
+
+} // namespace filesync
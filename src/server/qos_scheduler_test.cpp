@@ -0,0 +1,150 @@
+#include "qos_scheduler.h"
+// QoS scheduler admission and fairness tests
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace filesync {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Admit on another thread; true if the ticket was granted within `timeout`. A
+// stuck admission is left behind holding its own reference to the scheduler.
+bool AdmittedWithin(const std::shared_ptr<QosScheduler>& qos, QosClass cls, std::chrono::milliseconds timeout) {
+    auto admitted = std::make_shared<std::promise<void>>();
+    std::future<void> done = admitted->get_future();
+    std::thread([qos, cls, admitted] {
+        qos->Admit(cls, "client", 0);
+        admitted->set_value();
+    }).detach();
+    return done.wait_for(timeout) == std::future_status::ready;
+}
+
+int64_t Queued(QosScheduler& qos) {
+    int64_t queued = 0;
+    for (const auto& stats : qos.GetStats()) queued += stats.queued;
+    return queued;
+}
+
+// Every class is admitted when there is a single slot
+bool TestSingleSlot() {
+    QosOptions options;
+    options.slots = 1;
+    auto qos = std::make_shared<QosScheduler>(options);
+    for (QosClass cls : {QosClass::kInteractive, QosClass::kMetadata, QosClass::kSmallTransfer, QosClass::kBulkTransfer}) {
+        if (!AdmittedWithin(qos, cls, std::chrono::seconds(2))) {
+            std::cerr << "single slot: " << QosClassName(cls) << " was never admitted" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bulk transfers hold at most a quarter of the slots; other classes still get in
+bool TestBulkCap() {
+    QosOptions options;
+    options.slots = 8;
+    auto qos = std::make_shared<QosScheduler>(options);
+    auto first = qos->Admit(QosClass::kBulkTransfer, "client", 0);
+    auto second = qos->Admit(QosClass::kBulkTransfer, "client", 0);
+
+    auto third = std::async(std::launch::async, [&qos] { return qos->Admit(QosClass::kBulkTransfer, "client", 0); });
+    bool capped = third.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout;
+    bool others = AdmittedWithin(qos, QosClass::kSmallTransfer, std::chrono::seconds(2)) &&
+                  AdmittedWithin(qos, QosClass::kMetadata, std::chrono::seconds(2));
+    first.Release();
+    bool resumed = third.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+    if (!resumed) {
+        second.Release();
+        third.wait();
+    }
+    if (!capped || !others || !resumed) {
+        std::cerr << "bulk cap: capped " << capped << ", others admitted " << others << ", resumed " << resumed << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Waiting classes are served in proportion to their weights
+bool TestWeightedShare() {
+    QosOptions options;
+    options.slots = 1;
+    options.weights = {{0, 4, 2, 1}};
+    QosScheduler qos(options);
+    auto held = qos.Admit(QosClass::kMetadata, "client", 0);
+
+    const int kPerClass = 20;
+    std::mutex mutex;
+    std::vector<QosClass> order;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kPerClass; ++i) {
+        for (QosClass cls : {QosClass::kSmallTransfer, QosClass::kBulkTransfer}) {
+            threads.emplace_back([&, cls] {
+                auto ticket = qos.Admit(cls, "client", 0);
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(cls);
+            });
+        }
+    }
+    while (Queued(qos) < 2 * kPerClass) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    held.Release();
+    for (auto& thread : threads) thread.join();
+
+    // Small (weight 2) gets about two of every three grants while both are backlogged
+    int small = 0;
+    for (int i = 0; i < 15; ++i) {
+        if (order[i] == QosClass::kSmallTransfer) small++;
+    }
+    if (small < 8 || small > 12) {
+        std::cerr << "weighted share: small transfers got " << small << " of the first 15 grants" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// A client over its rate is delayed; interactive requests are neither delayed nor charged
+bool TestClientRate() {
+    QosOptions options;
+    options.client_rate_bytes = 10000;
+    options.client_burst_bytes = 1000;
+    QosScheduler qos(options);
+
+    auto start = Clock::now();
+    for (int i = 0; i < 10; ++i) qos.Admit(QosClass::kInteractive, "client", 1000000);
+    qos.Admit(QosClass::kSmallTransfer, "client", 1000);
+    if (Clock::now() - start > std::chrono::milliseconds(50)) {
+        std::cerr << "client rate: interactive requests delayed the client" << std::endl;
+        return false;
+    }
+
+    start = Clock::now();
+    qos.Admit(QosClass::kSmallTransfer, "client", 1000);
+    auto waited = Clock::now() - start;
+    qos.Admit(QosClass::kSmallTransfer, "other", 1000);
+    int64_t throttled = qos.GetStats()[static_cast<size_t>(QosClass::kSmallTransfer)].throttled;
+    if (waited < std::chrono::milliseconds(80) || throttled != 1) {
+        std::cerr << "client rate: over-rate transfer was not delayed (throttled " << throttled << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+} // namespace filesync
+
+int main() {
+    bool ok = filesync::TestSingleSlot();
+    ok = filesync::TestBulkCap() && ok;
+    ok = filesync::TestWeightedShare() && ok;
+    ok = filesync::TestClientRate() && ok;
+    std::cout << (ok ? "qos_scheduler_test: OK" : "qos_scheduler_test: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
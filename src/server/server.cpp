@@ -1,75 +1,443 @@
 #include "server.h"
 // Server implementation logic
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
 #include <memory>
 #include <string>
-#include <fstream>
 #include <vector>
+#include <unordered_set>
 #include <ctime>
+#include <cstdlib>
+#include <cstdio>
+#include <tuple>
+#include <cerrno>
+#include <unistd.h>
+#include "../common/logger.h"
+#include "../common/metrics.h"
+#include "../common/tracing.h"
 #include "../common/utils.h"
+#include "metrics_interceptor.h"
 
 namespace filesync {
 
-FileSyncServiceImpl::FileSyncServiceImpl(DBManager& db) : db_(db) {}
+namespace {
+
+const size_t kChunkSize = 1024 * 1024; // 1MB chunks
+
+// Batch RPC limits: every batched file fits in one chunk
+const int kMaxBatchFiles = 4096;
+const size_t kBatchFrameBytes = 1024 * 1024;
+// Batched uploads are synced and closed in groups to bound open descriptors
+const size_t kBatchSyncFiles = 64;
+// Distinguishes the staging names of concurrent uploads
+std::atomic<uint64_t> next_staging_id{0};
+// Largest file loaded into a CRDT document: it is read whole and held twice (the
+// run and its text snapshot), and each open takes that many IDs from the int32 clock
+const int64_t kMaxImportBytes = 16 * 1024 * 1024;
+
+struct ServerMetrics {
+    metrics::Counter& bytes_received;
+    metrics::Counter& bytes_sent;
+    metrics::Counter& storage_failovers;
+    metrics::Counter& replica_failures;
+    metrics::Counter& crdt_inserts;
+    metrics::Counter& crdt_deletes;
+};
+
+// Requests carrying x-filesync-trace-id are traced under the caller's id; with
+// tracing enabled server-wide every other request gets a fresh id.
+tracing::TraceContext TraceContextFor(grpc::ServerContext* context) {
+    tracing::TraceContext trace;
+    const auto& metadata = context->client_metadata();
+    auto it = metadata.find(tracing::kTraceMetadataKey);
+    if (it != metadata.end()) {
+        std::string id(it->second.data(), it->second.size());
+        trace.trace_id = std::strtoull(id.c_str(), nullptr, 16);
+    }
+    if (!trace.active() && tracing::Tracer::Global().enabled()) {
+        trace.trace_id = tracing::Tracer::Global().NewTraceId();
+    }
+    return trace;
+}
+
+// Rate-limiting key: the peer's address without its port, so parallel streams
+// from one client share a bucket
+std::string ClientKey(grpc::ServerContext* context) {
+    std::string peer = context->peer();
+    size_t port = peer.rfind(':');
+    return port == std::string::npos ? peer : peer.substr(0, port);
+}
+
+// Stored files live directly under storage/primary and storage/backup, so a name
+// must not reach outside them
+bool ValidFileName(const std::string& file_name) {
+    return !file_name.empty() && file_name.find('/') == std::string::npos &&
+           file_name.find("..") == std::string::npos && file_name.find('\0') == std::string::npos;
+}
+
+// Read exactly `length` bytes; a short read (EOF or error) fails, so a partial
+// chunk is never cached or sent
+bool ReadFully(StorageFile& file, int64_t offset, char* buffer, int64_t length) {
+    int64_t done = 0;
+    while (done < length) {
+        int64_t bytes_read = file.ReadAt(offset + done, buffer + done, static_cast<size_t>(length - done));
+        if (bytes_read <= 0) return false;
+        done += bytes_read;
+    }
+    return true;
+}
+
+ServerMetrics& Metrics() {
+    static auto& registry = metrics::Registry::Global();
+    static ServerMetrics server_metrics{
+        registry.GetCounter("filesync_bytes_received_total", "File bytes received by UploadFile"),
+        registry.GetCounter("filesync_bytes_sent_total", "File bytes sent by DownloadFile"),
+        registry.GetCounter("filesync_storage_failovers_total", "Downloads served from backup because primary failed"),
+        registry.GetCounter("filesync_storage_replica_failures_total", "Backup replica open/write/sync failures"),
+        registry.GetCounter("filesync_crdt_ops_total", "CRDT operations applied", {{"type", "insert"}}),
+        registry.GetCounter("filesync_crdt_ops_total", "CRDT operations applied", {{"type", "delete"}}),
+    };
+    return server_metrics;
+}
+
+} // namespace
+
+FileSyncServiceImpl::FileSyncServiceImpl(DBManager& db, const ServerOptions& options)
+    : db_(db), chunk_cache_(options.chunk_cache_bytes), storage_(CreateStorageEngine(options.storage_engine)),
+      qos_(options.qos) {
+    FILESYNC_LOG(Info) << "Storage engine: " << storage_->Name();
+
+    for (const auto& file : db_.GetAllFiles()) {
+        merkle_.Update({std::get<0>(file), std::get<1>(file), std::get<2>(file), std::get<3>(file)});
+    }
+}
+
+std::unique_ptr<StorageFile> FileSyncServiceImpl::OpenStoredFile(const std::string& file_name) {
+    // Try Primary
+    auto infile = storage_->OpenForRead("storage/primary/" + file_name);
+    if (!infile) {
+        FILESYNC_LOG(Warning) << "Primary storage failed for " << file_name << ". Attempting failover...";
+        // Failover to Backup
+        infile = storage_->OpenForRead("storage/backup/" + file_name);
+        if (!infile) return nullptr;
+        Metrics().storage_failovers.Add();
+        FILESYNC_LOG(Warning) << "Recovered " << file_name << " from Backup storage.";
+    } else {
+        FILESYNC_LOG(Debug) << "Serving " << file_name << " from Primary storage.";
+    }
+    return infile;
+}
+
+bool FileSyncServiceImpl::PublishFile(const std::string& file_name, const std::string& hash, int64_t size, int64_t timestamp) {
+    std::lock_guard<std::mutex> lock(publish_mutex_);
+    return PublishFileLocked(file_name, hash, size, timestamp);
+}
+
+bool FileSyncServiceImpl::PublishFileLocked(const std::string& file_name, const std::string& hash, int64_t size, int64_t timestamp) {
+    std::string old_hash;
+    int64_t old_size, old_timestamp;
+    bool had_previous = db_.GetFile(file_name, old_hash, old_size, old_timestamp);
+
+    bool ok = db_.AddFile(file_name, hash, size, timestamp);
+    if (ok) {
+        merkle_.Update({file_name, hash, size, timestamp});
+    }
+
+    // Chunks are keyed by content hash, so only the replaced version goes stale.
+    // The new hash is dropped too, in case a download raced the overwrite on disk.
+    if (had_previous && old_hash != hash) {
+        chunk_cache_.InvalidateFile(old_hash);
+    }
+    chunk_cache_.InvalidateFile(hash);
+    return ok;
+}
+
+bool FileSyncServiceImpl::PublishFilesLocked(const std::vector<FileRecord>& files) {
+    std::vector<std::string> replaced;
+    for (const auto& file : files) {
+        std::string old_hash;
+        int64_t old_size, old_timestamp;
+        if (db_.GetFile(file.name, old_hash, old_size, old_timestamp) && old_hash != file.hash) {
+            replaced.push_back(old_hash);
+        }
+    }
+
+    bool ok = db_.AddFiles(files);
+    if (ok) {
+        for (const auto& file : files) {
+            merkle_.Update(file);
+        }
+    }
+
+    for (const auto& hash : replaced) {
+        chunk_cache_.InvalidateFile(hash);
+    }
+    for (const auto& file : files) {
+        chunk_cache_.InvalidateFile(file.hash);
+    }
+    return ok;
+}
+
+bool FileSyncServiceImpl::InstallStagedLocked(std::vector<StagedFile>& files, const std::string& suffix) {
+    // Hard links keep the replaced versions until the metadata is committed
+    const std::string kept = suffix + ".old";
+    struct Moved {
+        StagedFile* file;
+        bool had_primary;
+        bool had_backup;
+        bool moved_backup;
+    };
+    std::vector<Moved> moved;
+    std::vector<FileRecord> records;
+    for (auto& file : files) {
+        std::string primary_path = "storage/primary/" + file.record.name;
+        std::string backup_path = "storage/backup/" + file.record.name;
+        std::remove((primary_path + kept).c_str()); // Left over from a crash
+        bool had_primary = link(primary_path.c_str(), (primary_path + kept).c_str()) == 0;
+        if (!had_primary && errno != ENOENT) continue;
+        if (std::rename((primary_path + suffix).c_str(), primary_path.c_str()) != 0) {
+            std::remove((primary_path + kept).c_str());
+            continue;
+        }
+        bool had_backup = false, moved_backup = false;
+        if (file.has_backup) {
+            std::remove((backup_path + kept).c_str());
+            had_backup = link(backup_path.c_str(), (backup_path + kept).c_str()) == 0;
+            moved_backup = (had_backup || errno == ENOENT) &&
+                           std::rename((backup_path + suffix).c_str(), backup_path.c_str()) == 0;
+            if (!moved_backup) {
+                Metrics().replica_failures.Add();
+                FILESYNC_LOG(Warning) << "Warning: Failed to move backup of " << file.record.name << " into place";
+            }
+        }
+        moved.push_back({&file, had_primary, had_backup, moved_backup});
+        records.push_back(file.record);
+    }
+
+    bool published = records.empty() || PublishFilesLocked(records);
+    for (const auto& entry : moved) {
+        std::string primary_path = "storage/primary/" + entry.file->record.name;
+        std::string backup_path = "storage/backup/" + entry.file->record.name;
+        if (published) {
+            entry.file->installed = true;
+        } else {
+            // Put the previous versions back under the metadata that still describes them
+            if (entry.had_primary) {
+                std::rename((primary_path + kept).c_str(), primary_path.c_str());
+            } else {
+                std::remove(primary_path.c_str());
+            }
+            if (entry.moved_backup) {
+                if (entry.had_backup) {
+                    std::rename((backup_path + kept).c_str(), backup_path.c_str());
+                } else {
+                    std::remove(backup_path.c_str());
+                }
+            }
+        }
+        std::remove((primary_path + kept).c_str());
+        std::remove((backup_path + kept).c_str());
+    }
+    return published;
+}
+
+bool FileSyncServiceImpl::SupersedesLocal(const FileRecord& file) {
+    std::string hash;
+    int64_t size, timestamp;
+    if (!db_.GetFile(file.name, hash, size, timestamp)) return true;
+    return std::tie(file.timestamp, file.hash) > std::tie(timestamp, hash);
+}
+
+bool FileSyncServiceImpl::StoreReplica(const FileRecord& file, const std::function<bool(std::string&)>& read_chunk) {
+    // Staged next to the live copies and renamed into place only if the replica wins
+    if (!ValidFileName(file.name)) return false;
+    const std::string suffix = ".filesync-replica-" + std::to_string(next_staging_id++);
+    std::string primary_path = "storage/primary/" + file.name;
+    std::string backup_path = "storage/backup/" + file.name;
+
+    auto primary = storage_->OpenForWrite(primary_path + suffix);
+    if (!primary) return false;
+    auto backup = storage_->OpenForWrite(backup_path + suffix);
+    if (!backup) {
+        Metrics().replica_failures.Add();
+    }
+
+    utils::SHA256Hasher hasher;
+    int64_t size = 0;
+    bool ok = true;
+    std::string data;
+    while (ok && read_chunk(data)) {
+        std::vector<StorageFile*> targets = {primary.get()};
+        if (backup) targets.push_back(backup.get());
+        std::vector<bool> written = storage_->AppendAll(targets, data.data(), data.size());
+        ok = written[0];
+        if (backup && !written[1]) {
+            Metrics().replica_failures.Add();
+            backup.reset();
+        }
+        hasher.Update(data.data(), data.size());
+        size += data.size();
+        Metrics().bytes_received.Add(data.size());
+    }
+
+    if (ok) {
+        std::vector<StorageFile*> targets = {primary.get()};
+        if (backup) targets.push_back(backup.get());
+        std::vector<bool> synced = storage_->SyncAll(targets);
+        ok = synced[0];
+        if (backup && !synced[1]) {
+            Metrics().replica_failures.Add();
+            backup.reset();
+        }
+    }
+    ok = ok && size == file.size && hasher.HexDigest() == file.hash;
+    bool have_backup = backup != nullptr;
+    primary.reset();
+    backup.reset();
+
+    if (ok) {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        std::vector<StagedFile> staged(1);
+        staged[0].record = file;
+        staged[0].has_backup = have_backup;
+        ok = SupersedesLocal(file) && InstallStagedLocked(staged, suffix) && staged[0].installed;
+    }
+    std::remove((primary_path + suffix).c_str());
+    std::remove((backup_path + suffix).c_str());
+    return ok;
+}
 
 grpc::Status FileSyncServiceImpl::UploadFile(grpc::ServerContext* context, grpc::ServerReader<FileChunk>* reader, UploadResponse* response) {
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span upload_span(trace, "upload");
+
+    // Written under a staging name and renamed into place once complete, so
+    // concurrent downloads never see a partly written file
+    const std::string suffix = ".filesync-upload-" + std::to_string(next_staging_id++);
     FileChunk chunk;
-    std::ofstream outfile_primary, outfile_backup;
+    std::unique_ptr<StorageFile> outfile_primary, outfile_backup;
     std::string file_name;
     int64_t total_size = 0;
+    utils::SHA256Hasher hasher;
     bool first_chunk = true;
+    std::string client = ClientKey(context);
+    QosClass qos_class = QosClass::kSmallTransfer;
+
+    auto discard = [&](grpc::Status status) {
+        outfile_primary.reset();
+        outfile_backup.reset();
+        if (!file_name.empty()) {
+            std::remove(("storage/primary/" + file_name + suffix).c_str());
+            std::remove(("storage/backup/" + file_name + suffix).c_str());
+        }
+        return status;
+    };
+
+    while (true) {
+        tracing::Span read_span(trace, "upload.network_read");
+        if (!reader->Read(&chunk)) break;
+        read_span.End();
 
-    while (reader->Read(&chunk)) {
         if (first_chunk) {
+            if (!ValidFileName(chunk.file_name())) {
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Missing or invalid file name");
+            }
             file_name = chunk.file_name();
+            qos_class = qos_.TransferClass(chunk.total_size());
             
             // Open Primary
-            outfile_primary.open("storage/primary/" + file_name, std::ios::binary);
-            if (!outfile_primary.is_open()) {
-                return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to open primary file for writing");
+            outfile_primary = storage_->OpenForWrite("storage/primary/" + file_name + suffix);
+            if (!outfile_primary) {
+                return discard(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to open primary file for writing"));
             }
             
             // Open Backup (Replication)
-            outfile_backup.open("storage/backup/" + file_name, std::ios::binary);
-            if (!outfile_backup.is_open()) {
-                std::cerr << "Warning: Failed to open backup file for writing" << std::endl;
+            outfile_backup = storage_->OpenForWrite("storage/backup/" + file_name + suffix);
+            if (!outfile_backup) {
+                Metrics().replica_failures.Add();
+                FILESYNC_LOG(Warning) << "Warning: Failed to open backup file for writing";
             } else {
-                std::cout << "Replicating " << file_name << " to backup..." << std::endl;
+                FILESYNC_LOG(Debug) << "Replicating " << file_name << " to backup...";
             }
             
             first_chunk = false;
         }
         
-        // Write to Primary
-        outfile_primary.write(chunk.data().c_str(), chunk.data().length());
-        
-        // Write to Backup
-        if (outfile_backup.is_open()) {
-            outfile_backup.write(chunk.data().c_str(), chunk.data().length());
+        // A stream without a declared size turns bulk once it gets large
+        if (qos_class != QosClass::kBulkTransfer) {
+            qos_class = qos_.TransferClass(total_size + chunk.data().length());
+        }
+        tracing::Span qos_span(trace, "upload.qos_wait", QosClassName(qos_class));
+        QosScheduler::Ticket ticket = qos_.Admit(qos_class, client, chunk.data().length());
+        qos_span.End();
+
+        // Write to Primary and Backup in one batch
+        std::vector<StorageFile*> targets = {outfile_primary.get()};
+        if (outfile_backup) targets.push_back(outfile_backup.get());
+        tracing::Span write_span(trace, "upload.storage_write", outfile_backup ? "primary+backup" : "primary");
+        std::vector<bool> written = storage_->AppendAll(targets, chunk.data().data(), chunk.data().length());
+        write_span.End();
+        if (!written[0]) {
+            return discard(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write chunk to primary storage"));
+        }
+        if (outfile_backup && !written[1]) {
+            Metrics().replica_failures.Add();
+            FILESYNC_LOG(Warning) << "Warning: Failed to write backup of " << file_name << ", dropping replica";
+            outfile_backup.reset();
         }
         
+        // Hashed as it streams in instead of re-reading the stored file
+        hasher.Update(chunk.data().data(), chunk.data().length());
         total_size += chunk.data().length();
+        Metrics().bytes_received.Add(chunk.data().length());
         
         // Track chunk in DB (simplified)
+        tracing::Span db_span(trace, "upload.db_add_chunk");
         db_.AddChunk(file_name, chunk.chunk_index(), "primary");
         db_.AddChunk(file_name, chunk.chunk_index(), "backup");
     }
-    
-    if (outfile_primary.is_open()) outfile_primary.close();
-    if (outfile_backup.is_open()) outfile_backup.close();
+    if (first_chunk) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Empty upload stream");
+    }
 
-    // Calculate hash and update DB
-    // Note: In a real system we'd hash the stream or the saved file. 
-    // Here we hash the primary.
-    std::string hash = utils::CalculateSHA256("storage/primary/" + file_name);
-    int64_t timestamp = std::time(nullptr);
-    db_.AddFile(file_name, hash, total_size, timestamp);
+    // Durability point: data must be on disk before the new version is published.
+    std::vector<StorageFile*> targets = {outfile_primary.get()};
+    if (outfile_backup) targets.push_back(outfile_backup.get());
+    tracing::Span sync_span(trace, "upload.sync", file_name);
+    std::vector<bool> synced = storage_->SyncAll(targets);
+    sync_span.End();
+    if (!synced[0]) {
+        return discard(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to sync primary storage"));
+    }
+    if (outfile_backup && !synced[1]) {
+        Metrics().replica_failures.Add();
+        FILESYNC_LOG(Warning) << "Warning: Failed to sync backup of " << file_name;
+        outfile_backup.reset();
+    }
+    std::vector<StagedFile> staged(1);
+    staged[0].record = {file_name, hasher.HexDigest(), total_size, static_cast<int64_t>(std::time(nullptr))};
+    staged[0].has_backup = outfile_backup != nullptr;
+    outfile_primary.reset();
+    outfile_backup.reset();
+
+    tracing::Span publish_span(trace, "upload.publish", file_name);
+    {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        InstallStagedLocked(staged, suffix);
+    }
+    publish_span.End();
+    if (!staged[0].installed) {
+        return discard(grpc::Status(grpc::StatusCode::INTERNAL, "Failed to publish the new version"));
+    }
+    // A backup copy that could not be moved into place is dropped
+    std::remove(("storage/backup/" + file_name + suffix).c_str());
 
     response->set_success(true);
     response->set_message("Upload successful (Replicated to Primary & Backup)");
     response->set_file_id(file_name);
     
-    std::cout << "File uploaded: " << file_name << " Size: " << total_size << " Hash: " << hash << std::endl;
+    FILESYNC_LOG(Info) << "File uploaded: " << file_name << " Size: " << total_size << " Hash: " << staged[0].record.hash;
     return grpc::Status::OK;
 }
 
@@ -77,57 +445,378 @@ grpc::Status FileSyncServiceImpl::DownloadFile(grpc::ServerContext* context, con
     std::string file_name = request->file_name();
     std::string hash;
     int64_t size, timestamp;
+
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span download_span(trace, "download", file_name);
     
+    tracing::Span lookup_span(trace, "download.db_lookup");
     if (!db_.GetFile(file_name, hash, size, timestamp)) {
         return grpc::Status(grpc::StatusCode::NOT_FOUND, "File not found in metadata");
     }
+    lookup_span.End();
 
-    // Try Primary
-    std::string file_path = "storage/primary/" + file_name;
-    std::ifstream infile(file_path, std::ios::binary);
-    
-    if (!infile.is_open()) {
-        std::cerr << "Primary storage failed for " << file_name << ". Attempting failover..." << std::endl;
-        // Failover to Backup
-        file_path = "storage/backup/" + file_name;
-        infile.open(file_path, std::ios::binary);
-        
-        if (!infile.is_open()) {
-            return grpc::Status(grpc::StatusCode::INTERNAL, "File lost! Failed to open from Primary and Backup.");
+    // Ranges of one parallel download must all come from the same version
+    if (!request->expected_hash().empty() && request->expected_hash() != hash) {
+        return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "File changed since the download started");
+    }
+
+    if (request->offset() < 0 || request->length() < 0) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Negative offset or length");
+    }
+    if (request->offset() > size) {
+        return grpc::Status(grpc::StatusCode::OUT_OF_RANGE, "Offset past end of file");
+    }
+    int64_t range_begin = request->offset();
+    int64_t range_end = request->length() == 0 ? size : std::min(size, range_begin + request->length());
+    bool is_range = request->offset() != 0 || request->length() != 0;
+
+    // An empty range (an empty file, or an offset at its end) is one empty last chunk
+    if (range_begin == range_end) {
+        FileChunk chunk;
+        chunk.set_file_name(file_name);
+        chunk.set_chunk_index(static_cast<int32_t>(range_begin / kChunkSize));
+        chunk.set_offset(range_begin);
+        chunk.set_is_last_chunk(true);
+        chunk.set_total_size(size);
+        chunk.set_file_hash(hash);
+        if (is_range) {
+            utils::SHA256Hasher empty_hasher;
+            chunk.set_range_hash(empty_hasher.HexDigest());
         }
-        std::cout << "Recovered " << file_name << " from Backup storage." << std::endl;
-    } else {
-        std::cout << "Serving " << file_name << " from Primary storage." << std::endl;
+        if (!writer->Write(chunk)) {
+            return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write chunk to stream");
+        }
+        return grpc::Status::OK;
     }
 
-    const size_t kChunkSize = 1024 * 1024; // 1MB chunks
-    std::vector<char> buffer(kChunkSize);
-    int32_t chunk_index = 0;
+    // The file is opened lazily: chunks already in the cache are served without touching disk.
+    std::unique_ptr<StorageFile> infile;
+    bool open_attempted = false;
+    auto open_storage = [&]() -> bool {
+        if (open_attempted) return infile != nullptr;
+        open_attempted = true;
+
+        infile = OpenStoredFile(file_name);
+        return infile != nullptr;
+    };
+
+    // The range is served from whole cache chunks, trimmed at both ends
+    int32_t first_chunk = static_cast<int32_t>(range_begin / kChunkSize);
+    int32_t end_chunk = static_cast<int32_t>((range_end + kChunkSize - 1) / kChunkSize);
+    utils::SHA256Hasher range_hasher;
+    std::string client = ClientKey(context);
+    QosClass qos_class = qos_.TransferClass(range_end - range_begin);
+
+    for (int32_t chunk_index = first_chunk; chunk_index < end_chunk; ++chunk_index) {
+        // The slot covers the chunk load only, not the network write to a possibly slow client
+        int64_t chunk_bytes = std::min<int64_t>(range_end, static_cast<int64_t>(chunk_index + 1) * kChunkSize) -
+                              std::max<int64_t>(range_begin, static_cast<int64_t>(chunk_index) * kChunkSize);
+        tracing::Span qos_span(trace, "download.qos_wait", QosClassName(qos_class));
+        QosScheduler::Ticket ticket = qos_.Admit(qos_class, client, chunk_bytes);
+        qos_span.End();
+        auto data = chunk_cache_.GetOrLoad(hash, chunk_index, [&]() -> ChunkCache::ChunkData {
+            tracing::Span load_span(trace, "download.chunk_load", file_name);
+            if (!open_storage()) return nullptr;
+            // Sized to the chunk so a short tail does not pin a full 1 MB in the cache
+            int64_t chunk_length = std::min<int64_t>(kChunkSize, size - static_cast<int64_t>(chunk_index) * kChunkSize);
+            auto buffer = std::make_shared<std::string>(chunk_length, '\0');
+            if (!ReadFully(*infile, static_cast<int64_t>(chunk_index) * kChunkSize, &(*buffer)[0], chunk_length)) return nullptr;
+            return buffer;
+        });
+        ticket.Release();
+
+        if (!data) {
+            if (open_attempted && !infile) {
+                return grpc::Status(grpc::StatusCode::INTERNAL, "File lost! Failed to open from Primary and Backup.");
+            }
+            return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to read chunk from storage");
+        }
+
+        int64_t chunk_begin = static_cast<int64_t>(chunk_index) * kChunkSize;
+        int64_t slice_begin = std::max(range_begin, chunk_begin) - chunk_begin;
+        int64_t slice_end = std::min<int64_t>(range_end - chunk_begin, data->size());
+        if (slice_end <= slice_begin) {
+            return grpc::Status(grpc::StatusCode::INTERNAL, "Stored file is shorter than its metadata");
+        }
+        const char* slice = data->data() + slice_begin;
+        size_t slice_length = static_cast<size_t>(slice_end - slice_begin);
 
-    while (infile.read(buffer.data(), kChunkSize) || infile.gcount() > 0) {
         FileChunk chunk;
         chunk.set_file_name(file_name);
-        chunk.set_chunk_index(chunk_index++);
-        chunk.set_data(buffer.data(), infile.gcount());
-        chunk.set_is_last_chunk(infile.eof());
-        if (chunk_index == 1) {
+        chunk.set_chunk_index(chunk_index);
+        chunk.set_offset(chunk_begin + slice_begin);
+        chunk.set_data(slice, slice_length);
+        chunk.set_is_last_chunk(chunk_index == end_chunk - 1);
+        if (chunk_index == first_chunk) {
              chunk.set_total_size(size);
              chunk.set_file_hash(hash);
         }
-        
+        if (is_range) {
+            range_hasher.Update(slice, slice_length);
+            if (chunk.is_last_chunk()) chunk.set_range_hash(range_hasher.HexDigest());
+        }
+
+        tracing::Span write_span(trace, "download.network_write");
         if (!writer->Write(chunk)) {
             return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write chunk to stream");
         }
-        
-        if (infile.eof()) break;
+        write_span.End();
+        Metrics().bytes_sent.Add(slice_length);
+    }
+
+    return grpc::Status::OK;
+}
+
+
+
+grpc::Status FileSyncServiceImpl::BatchUpload(grpc::ServerContext* context, grpc::ServerReader<BatchFileFrame>* reader, BatchUploadResponse* response) {
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span batch_span(trace, "batch_upload");
+
+    // Files are staged next to the live copies and only renamed into place when
+    // the batch is published, so a rejected or failed batch leaves them untouched
+    const std::string suffix = ".filesync-batch-" + std::to_string(next_staging_id++);
+    std::vector<std::string> staged;
+
+    // Written but not yet synced
+    struct PendingFile {
+        int result_index;
+        FileRecord record;
+        std::unique_ptr<StorageFile> primary;
+        std::unique_ptr<StorageFile> backup;
+    };
+    std::vector<PendingFile> pending;
+    // Synced and waiting for the single metadata transaction
+    std::vector<StagedFile> ready;
+    std::vector<int> ready_results;
+    std::unordered_set<std::string> seen;
+    int64_t timestamp = std::time(nullptr);
+    std::string client = ClientKey(context);
+
+    auto fail = [&](int index, const std::string& message) {
+        auto* result = response->mutable_results(index);
+        result->set_success(false);
+        result->set_message(message);
+    };
+
+    // Durability point for a group: data must be on disk before it is published
+    auto flush = [&]() {
+        std::vector<StorageFile*> targets;
+        for (const auto& file : pending) {
+            targets.push_back(file.primary.get());
+            if (file.backup) targets.push_back(file.backup.get());
+        }
+        tracing::Span sync_span(trace, "batch_upload.sync");
+        std::vector<bool> synced = storage_->SyncAll(targets);
+        sync_span.End();
+
+        size_t target = 0;
+        for (auto& file : pending) {
+            bool primary_ok = synced[target++];
+            if (file.backup && !synced[target++]) {
+                Metrics().replica_failures.Add();
+                FILESYNC_LOG(Warning) << "Warning: Failed to sync backup of " << file.record.name;
+            }
+            if (!primary_ok) {
+                fail(file.result_index, "Failed to sync primary storage");
+                continue;
+            }
+            StagedFile staged_file;
+            staged_file.record = std::move(file.record);
+            staged_file.has_backup = file.backup != nullptr;
+            ready.push_back(std::move(staged_file));
+            ready_results.push_back(file.result_index);
+        }
+        pending.clear();
+    };
+
+    BatchFileFrame frame;
+    while (true) {
+        tracing::Span read_span(trace, "batch_upload.network_read");
+        if (!reader->Read(&frame)) break;
+        read_span.End();
+
+        for (const auto& file : frame.files()) {
+            int index = response->results_size();
+            if (index >= kMaxBatchFiles) {
+                pending.clear();
+                for (const auto& path : staged) std::remove(path.c_str());
+                return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Batch exceeds " + std::to_string(kMaxBatchFiles) + " files");
+            }
+            auto* result = response->add_results();
+            result->set_file_name(file.file_name());
+
+            if (!ValidFileName(file.file_name())) {
+                fail(index, "Missing or invalid file name");
+                continue;
+            }
+            if (file.data().size() > kChunkSize) {
+                fail(index, "File larger than 1 MB, use UploadFile");
+                continue;
+            }
+            if (!seen.insert(file.file_name()).second) {
+                fail(index, "Duplicate file name in batch");
+                continue;
+            }
+
+            // Hash from memory instead of re-reading the stored file
+            utils::SHA256Hasher hasher;
+            hasher.Update(file.data().data(), file.data().size());
+            std::string hash = hasher.HexDigest();
+            if (!file.file_hash().empty() && file.file_hash() != hash) {
+                fail(index, "Hash mismatch");
+                continue;
+            }
+
+            QosScheduler::Ticket ticket = qos_.Admit(QosClass::kSmallTransfer, client, file.data().size());
+            PendingFile stored;
+            stored.result_index = index;
+            stored.record = {file.file_name(), hash, static_cast<int64_t>(file.data().size()), timestamp};
+            staged.push_back("storage/primary/" + file.file_name() + suffix);
+            staged.push_back("storage/backup/" + file.file_name() + suffix);
+            stored.primary = storage_->OpenForWrite("storage/primary/" + file.file_name() + suffix);
+            if (!stored.primary) {
+                fail(index, "Failed to open primary file for writing");
+                continue;
+            }
+            stored.backup = storage_->OpenForWrite("storage/backup/" + file.file_name() + suffix);
+            if (!stored.backup) {
+                Metrics().replica_failures.Add();
+                FILESYNC_LOG(Warning) << "Warning: Failed to open backup file for writing";
+            }
+
+            if (!file.data().empty()) {
+                std::vector<StorageFile*> targets = {stored.primary.get()};
+                if (stored.backup) targets.push_back(stored.backup.get());
+                tracing::Span write_span(trace, "batch_upload.storage_write", file.file_name());
+                std::vector<bool> written = storage_->AppendAll(targets, file.data().data(), file.data().size());
+                write_span.End();
+                if (!written[0]) {
+                    fail(index, "Failed to write primary storage");
+                    continue;
+                }
+                if (stored.backup && !written[1]) {
+                    Metrics().replica_failures.Add();
+                    FILESYNC_LOG(Warning) << "Warning: Failed to write backup of " << file.file_name() << ", dropping replica";
+                    stored.backup.reset();
+                }
+            }
+            Metrics().bytes_received.Add(file.data().size());
+
+            pending.push_back(std::move(stored));
+            if (pending.size() >= kBatchSyncFiles) flush();
+        }
     }
+    flush();
 
+    tracing::Span publish_span(trace, "batch_upload.publish");
+    bool published = true;
+    if (!ready.empty()) {
+        std::lock_guard<std::mutex> lock(publish_mutex_);
+        published = InstallStagedLocked(ready, suffix);
+    }
+    publish_span.End();
+    for (const auto& path : staged) std::remove(path.c_str());
+
+    size_t stored = 0;
+    for (size_t i = 0; i < ready.size(); ++i) {
+        if (!published) {
+            fail(ready_results[i], "Failed to record file metadata");
+            continue;
+        }
+        if (!ready[i].installed) {
+            fail(ready_results[i], "Failed to move file into primary storage");
+            continue;
+        }
+        auto* result = response->mutable_results(ready_results[i]);
+        result->set_success(true);
+        result->set_file_hash(ready[i].record.hash);
+        stored++;
+    }
+
+    FILESYNC_LOG(Info) << "Batch upload: " << stored << " of " << response->results_size() << " files stored";
     return grpc::Status::OK;
 }
 
+grpc::Status FileSyncServiceImpl::BatchDownload(grpc::ServerContext* context, const BatchDownloadRequest* request, grpc::ServerWriter<BatchFileFrame>* writer) {
+    if (request->file_names_size() > kMaxBatchFiles) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Batch exceeds " + std::to_string(kMaxBatchFiles) + " files");
+    }
 
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span batch_span(trace, "batch_download");
+
+    BatchFileFrame frame;
+    size_t frame_bytes = 0;
+    auto send_frame = [&]() -> bool {
+        if (frame.files_size() == 0) return true;
+        tracing::Span write_span(trace, "batch_download.network_write");
+        bool ok = writer->Write(frame);
+        frame.Clear();
+        frame_bytes = 0;
+        return ok;
+    };
+
+    std::string client = ClientKey(context);
+    for (const auto& file_name : request->file_names()) {
+        BatchFile* file = frame.add_files();
+        file->set_file_name(file_name);
+
+        std::string hash;
+        int64_t size, timestamp;
+        if (!db_.GetFile(file_name, hash, size, timestamp)) {
+            file->set_error("File not found in metadata");
+        } else if (size > static_cast<int64_t>(kChunkSize)) {
+            file->set_error("File larger than 1 MB, use DownloadFile");
+        } else if (size > 0) {
+            QosScheduler::Ticket ticket = qos_.Admit(QosClass::kSmallTransfer, client, size);
+            // A small file is exactly chunk 0, so it shares the DownloadFile cache entry
+            auto data = chunk_cache_.GetOrLoad(hash, 0, [&]() -> ChunkCache::ChunkData {
+                tracing::Span load_span(trace, "batch_download.chunk_load", file_name);
+                auto infile = OpenStoredFile(file_name);
+                if (!infile) return nullptr;
+                auto buffer = std::make_shared<std::string>(size, '\0');
+                if (!ReadFully(*infile, 0, &(*buffer)[0], size)) return nullptr;
+                return buffer;
+            });
+            if (!data || static_cast<int64_t>(data->size()) != size) {
+                file->set_error("Failed to read file from storage");
+            } else {
+                file->set_data(*data);
+                file->set_file_hash(hash);
+                frame_bytes += data->size();
+                Metrics().bytes_sent.Add(data->size());
+            }
+        } else {
+            file->set_file_hash(hash);
+        }
+
+        if (frame_bytes >= kBatchFrameBytes && !send_frame()) {
+            return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write frame to stream");
+        }
+    }
+    if (!send_frame()) {
+        return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to write frame to stream");
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status FileSyncServiceImpl::GetFileInfo(grpc::ServerContext* context, const FileRequest* request, FileInfo* response) {
+    QosScheduler::Ticket ticket = qos_.Admit(QosClass::kMetadata, ClientKey(context), 0);
+    std::string hash;
+    int64_t size, timestamp;
+    if (!db_.GetFile(request->file_name(), hash, size, timestamp)) {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "File not found in metadata");
+    }
+    response->set_file_name(request->file_name());
+    response->set_file_hash(hash);
+    response->set_file_size(size);
+    response->set_timestamp(timestamp);
+    return grpc::Status::OK;
+}
 
 grpc::Status FileSyncServiceImpl::ListFiles(grpc::ServerContext* context, const ListFilesRequest* request, FileListResponse* response) {
+    QosScheduler::Ticket ticket = qos_.Admit(QosClass::kMetadata, ClientKey(context), 0);
     auto files = db_.GetAllFiles();
     for (const auto& file : files) {
         auto* file_info = response->add_files();
@@ -139,22 +828,126 @@ grpc::Status FileSyncServiceImpl::ListFiles(grpc::ServerContext* context, const
     return grpc::Status::OK;
 }
 
-CRDTServiceImpl::CRDTServiceImpl() : crdt_manager_("server") {}
+grpc::Status FileSyncServiceImpl::GetStats(grpc::ServerContext* context, const StatsRequest* request, StatsResponse* response) {
+    ChunkCache::Stats cache = chunk_cache_.GetStats();
+    response->set_cache_hits(cache.hits);
+    response->set_cache_misses(cache.misses);
+    response->set_cache_hit_ratio(cache.HitRatio());
+    response->set_cache_bytes_saved(cache.bytes_saved);
+    response->set_cache_bytes_used(cache.bytes_used);
+    response->set_cache_capacity_bytes(cache.capacity_bytes);
+    response->set_cache_evictions(cache.evictions);
+    response->set_cache_coalesced_misses(cache.coalesced);
+
+    for (const auto& qos : qos_.GetStats()) {
+        auto* class_stats = response->add_qos();
+        class_stats->set_name(QosClassName(qos.cls));
+        class_stats->set_weight(qos.weight);
+        class_stats->set_admitted(qos.admitted);
+        class_stats->set_bytes(qos.bytes);
+        class_stats->set_active(qos.active);
+        class_stats->set_queued(qos.queued);
+        class_stats->set_throttled(qos.throttled);
+        class_stats->set_throttle_wait_us(qos.throttle_wait_us);
+        class_stats->set_queue_wait_p50_us(qos.queue_wait_p50_us);
+        class_stats->set_queue_wait_p99_us(qos.queue_wait_p99_us);
+    }
+    response->set_qos_slots(qos_.options().slots);
+    response->set_qos_client_rate_bytes(qos_.options().client_rate_bytes);
+
+    std::ostringstream text;
+    text << metrics::Registry::Global().RenderPrometheus();
+    text << "# HELP filesync_chunk_cache_hits_total Chunk cache hits\n# TYPE filesync_chunk_cache_hits_total counter\n";
+    text << "filesync_chunk_cache_hits_total " << cache.hits << "\n";
+    text << "# HELP filesync_chunk_cache_misses_total Chunk cache misses\n# TYPE filesync_chunk_cache_misses_total counter\n";
+    text << "filesync_chunk_cache_misses_total " << cache.misses << "\n";
+    text << "# HELP filesync_chunk_cache_bytes_saved_total Bytes served from the chunk cache\n# TYPE filesync_chunk_cache_bytes_saved_total counter\n";
+    text << "filesync_chunk_cache_bytes_saved_total " << cache.bytes_saved << "\n";
+    text << "# HELP filesync_chunk_cache_bytes Bytes held by the chunk cache\n# TYPE filesync_chunk_cache_bytes gauge\n";
+    text << "filesync_chunk_cache_bytes " << cache.bytes_used << "\n";
+    text << "# HELP filesync_log_dropped_total Log messages dropped because the writer fell behind\n# TYPE filesync_log_dropped_total counter\n";
+    text << "filesync_log_dropped_total " << Logger::Instance().dropped() << "\n";
+    response->set_prometheus_text(text.str());
+    return grpc::Status::OK;
+}
+
+grpc::Status FileSyncServiceImpl::GetTrace(grpc::ServerContext* context, const TraceRequest* request, TraceResponse* response) {
+    auto& tracer = tracing::Tracer::Global();
+    if (request->mode() == TraceRequest::ENABLE) {
+        tracer.SetEnabled(true);
+    } else if (request->mode() == TraceRequest::DISABLE) {
+        tracer.SetEnabled(false);
+    }
+    response->set_trace_json(tracer.DumpChromeJson(request->clear()));
+    response->set_enabled(tracer.enabled());
+    return grpc::Status::OK;
+}
+
+bool FileSyncServiceImpl::GetFileRecord(const std::string& file_name, FileRecord& file) {
+    file.name = file_name;
+    return db_.GetFile(file_name, file.hash, file.size, file.timestamp);
+}
+
+bool FileSyncServiceImpl::ReadFile(const std::string& file_name, int64_t max_size, FileRecord& file, std::string& data) {
+    file.name = file_name;
+    if (!db_.GetFile(file_name, file.hash, file.size, file.timestamp) || file.size > max_size) return false;
+    auto infile = OpenStoredFile(file_name);
+    if (!infile) return false;
+
+    data.assign(file.size, '\0');
+    if (!ReadFully(*infile, 0, &data[0], file.size)) return false;
+    // An upload may be rewriting the file in place
+    utils::SHA256Hasher hasher;
+    hasher.Update(data.data(), data.size());
+    return hasher.HexDigest() == file.hash;
+}
+
+bool FileSyncServiceImpl::StoreFile(const std::string& file_name, const std::string& data, FileRecord& file) {
+    utils::SHA256Hasher hasher;
+    hasher.Update(data.data(), data.size());
+    file = {file_name, hasher.HexDigest(), static_cast<int64_t>(data.size()), std::time(nullptr)};
+
+    FileRecord current;
+    if (db_.GetFile(file_name, current.hash, current.size, current.timestamp)) {
+        if (current.hash == file.hash) {
+            file.timestamp = current.timestamp; // Already the current version
+            return true;
+        }
+        file.timestamp = std::max(file.timestamp, current.timestamp + 1);
+    }
+
+    size_t offset = 0;
+    return StoreReplica(file, [&](std::string& chunk) -> bool {
+        if (offset >= data.size()) return false;
+        size_t length = std::min(kChunkSize, data.size() - offset);
+        chunk.assign(data, offset, length);
+        offset += length;
+        return true;
+    });
+}
+
+CRDTServiceImpl::CRDTServiceImpl(FileSyncServiceImpl& files) : files_(files), crdt_manager_("server") {}
 
 grpc::Status CRDTServiceImpl::ApplyCRDTUpdate(grpc::ServerContext* context, const CRDTOperation* request, CRDTResponse* response) {
     std::string file_name = request->file_name();
+    tracing::TraceContext trace = TraceContextFor(context);
+    QosScheduler::Ticket ticket = files_.qos().Admit(QosClass::kInteractive, ClientKey(context), request->content().size());
     
     if (request->type() == CRDTOperation::INSERT) {
+        tracing::Span span(trace, "crdt.apply_insert", file_name);
         CharID id = {request->site_id(), request->clock()};
         CharID origin_left = {request->origin_left_site(), request->origin_left_clock()};
         char content = request->content()[0];
         
         crdt_manager_.ApplyInsert(file_name, content, id, origin_left);
-        std::cout << "Applied Insert: " << content << " from " << request->site_id() << std::endl;
+        Metrics().crdt_inserts.Add();
+        FILESYNC_LOG(Debug) << "Applied Insert: " << content << " from " << request->site_id();
     } else if (request->type() == CRDTOperation::DELETE) {
+        tracing::Span span(trace, "crdt.apply_delete", file_name);
         CharID target_id = {request->target_site(), request->target_clock()};
         crdt_manager_.ApplyDelete(file_name, target_id);
-        std::cout << "Applied Delete from " << request->site_id() << std::endl;
+        Metrics().crdt_deletes.Add();
+        FILESYNC_LOG(Debug) << "Applied Delete from " << request->site_id();
     }
     
     response->set_success(true);
@@ -162,29 +955,147 @@ grpc::Status CRDTServiceImpl::ApplyCRDTUpdate(grpc::ServerContext* context, cons
 }
 
 grpc::Status CRDTServiceImpl::GetCRDTState(grpc::ServerContext* context, const CRDTStateRequest* request, CRDTStateResponse* response) {
-    std::string text = crdt_manager_.GetText(request->file_name());
-    response->set_content(text);
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span span(trace, "crdt.get_text", request->file_name());
+    if (request->offset() < 0 || request->length() < 0) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid range");
+    }
+    QosScheduler::Ticket ticket = files_.qos().Admit(QosClass::kInteractive, ClientKey(context), request->length());
+    // Served from the materialized snapshot; concurrent edits are not blocked
+    auto text = crdt_manager_.Snapshot(request->file_name());
+    size_t offset = static_cast<size_t>(request->offset());
+    size_t length = request->length() == 0 ? text->size() : static_cast<size_t>(request->length());
+    response->set_content(text->Substr(offset, length));
+    response->set_total_length(text->size());
+    return grpc::Status::OK;
+}
+
+grpc::Status CRDTServiceImpl::ImportFile(grpc::ServerContext* context, const CRDTImportRequest* request, CRDTImportResponse* response) {
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span span(trace, "crdt.import", request->file_name());
+    // Scheduled like a download of the file; an unknown file costs nothing
+    FileRecord file;
+    int64_t size = files_.GetFileRecord(request->file_name(), file) ? std::min(file.size, kMaxImportBytes) : 0;
+    QosScheduler::Ticket ticket = files_.qos().Admit(files_.qos().TransferClass(size), ClientKey(context), size);
+    std::string text;
+    if (!files_.ReadFile(request->file_name(), kMaxImportBytes, file, text)) {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "File not found, unreadable or larger than 16 MB");
+    }
+
+    // Opening a document again returns its run while it still matches this version
+    auto reopen = [&]() {
+        CRDTManager::ImportedRun run;
+        if (!crdt_manager_.GetImportedRun(request->file_name(), run) || run.source != file.hash) return false;
+        response->set_site_id(run.first_id.site_id);
+        response->set_first_clock(run.first_id.clock);
+        response->set_length(run.length);
+        response->set_file_hash(run.source);
+        return true;
+    };
+    if (reopen()) return grpc::Status::OK;
+
+    CharID first_id;
+    if (!crdt_manager_.ReserveIds(text.size(), first_id)) {
+        return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "CRDT clock exhausted");
+    }
+    if (!crdt_manager_.Import(request->file_name(), text, first_id, file.hash)) {
+        if (reopen()) return grpc::Status::OK; // Lost a race with another open
+        return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Document was edited or imported from another version");
+    }
+    response->set_site_id(first_id.site_id);
+    response->set_first_clock(first_id.clock);
+    response->set_length(text.size());
+    response->set_file_hash(file.hash);
+    FILESYNC_LOG(Info) << "Imported " << request->file_name() << " into CRDT (" << text.size() << " characters)";
     return grpc::Status::OK;
 }
 
-void RunServer(const std::string& server_address, const std::string& db_path) {
-    DBManager db(db_path);
-    if (!db.Init()) {
-        std::cerr << "Failed to initialize database" << std::endl;
-        return;
+grpc::Status CRDTServiceImpl::ExportFile(grpc::ServerContext* context, const CRDTExportRequest* request, CRDTExportResponse* response) {
+    tracing::TraceContext trace = TraceContextFor(context);
+    tracing::Span span(trace, "crdt.export", request->file_name());
+    if (!ValidFileName(request->file_name())) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid file name");
     }
+    if (!crdt_manager_.HasDocument(request->file_name())) {
+        return grpc::Status(grpc::StatusCode::NOT_FOUND, "No CRDT document for this file");
+    }
+    int64_t size = static_cast<int64_t>(crdt_manager_.Snapshot(request->file_name())->size());
+    QosScheduler::Ticket ticket = files_.qos().Admit(files_.qos().TransferClass(size), ClientKey(context), size);
 
-    FileSyncServiceImpl service(db);
-    CRDTServiceImpl crdt_service;
+    FileRecord file;
+    if (!files_.StoreFile(request->file_name(), crdt_manager_.GetText(request->file_name()), file)) {
+        return grpc::Status(grpc::StatusCode::INTERNAL, "Failed to store file version");
+    }
+    response->set_file_hash(file.hash);
+    response->set_file_size(file.size);
+    response->set_timestamp(file.timestamp);
+    FILESYNC_LOG(Info) << "Exported CRDT document " << file.name << " Size: " << file.size << " Hash: " << file.hash;
+    return grpc::Status::OK;
+}
+
+FileSyncServer::FileSyncServer(const std::string& server_address, const std::string& db_path, const ServerOptions& options)
+    : server_address_(server_address), options_(options), db_(db_path) {}
+
+FileSyncServer::~FileSyncServer() {
+    Shutdown();
+}
+
+bool FileSyncServer::Start() {
+    if (!db_.Init()) {
+        FILESYNC_LOG(Error) << "Failed to initialize database";
+        return false;
+    }
+
+    service_ = std::make_unique<FileSyncServiceImpl>(db_, options_);
+    crdt_service_ = std::make_unique<CRDTServiceImpl>(*service_);
+    cluster_service_ = std::make_unique<ClusterServiceImpl>(db_, service_->merkle());
 
     grpc::ServerBuilder builder;
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-    builder.RegisterService(&service);
-    builder.RegisterService(&crdt_service);
-    
-    std::unique_ptr<grpc::Server> server(builder.BuildAndStart());
-    std::cout << "Server listening on " << server_address << std::endl;
-    server->Wait();
+    builder.AddListeningPort(server_address_, grpc::InsecureServerCredentials(), &selected_port_);
+    std::vector<std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>> interceptors;
+    interceptors.push_back(std::make_unique<MetricsInterceptorFactory>());
+    builder.experimental().SetInterceptorCreators(std::move(interceptors));
+    builder.RegisterService(service_.get());
+    builder.RegisterService(crdt_service_.get());
+    builder.RegisterService(cluster_service_.get());
+
+    server_ = builder.BuildAndStart();
+    if (!server_ || selected_port_ == 0) {
+        FILESYNC_LOG(Error) << "Failed to listen on " << server_address_;
+        server_.reset();
+        return false;
+    }
+    FILESYNC_LOG(Info) << "Server listening on " << server_address_;
+
+    if (!options_.peers.empty()) {
+        anti_entropy_ = std::make_unique<AntiEntropy>(*service_, service_->merkle(), options_.peers, options_.anti_entropy_interval_ms);
+        anti_entropy_->Start();
+        FILESYNC_LOG(Info) << "Anti-entropy with " << options_.peers.size() << " peer(s) every " << options_.anti_entropy_interval_ms << " ms";
+    }
+    return true;
+}
+
+void FileSyncServer::Wait() {
+    if (server_) server_->Wait();
+}
+
+void FileSyncServer::Shutdown() {
+    if (anti_entropy_) {
+        anti_entropy_->Stop();
+        anti_entropy_.reset();
+    }
+    if (server_) {
+        server_->Shutdown();
+        server_->Wait();
+        server_.reset();
+    }
+    Logger::Instance().Flush();
+}
+
+void RunServer(const std::string& server_address, const std::string& db_path, const ServerOptions& options) {
+    FileSyncServer server(server_address, db_path, options);
+    if (!server.Start()) return;
+    server.Wait();
 }
 
 } // namespace filesync
@@ -6,31 +6,131 @@
 #include "crdt.grpc.pb.h"
 #include "../db/db_manager.h"
 #include "../common/crdt_manager.h"
+#include <functional>
+#include <mutex>
+#include "chunk_cache.h"
+#include "cluster.h"
+#include "merkle_tree.h"
+#include "qos_scheduler.h"
+#include "storage_engine.h"
 
 namespace filesync {
 
+// Tunables passed from the command line to RunServer
+struct ServerOptions {
+    size_t chunk_cache_bytes = 256 * 1024 * 1024;
+    std::string storage_engine = "auto"; // auto, io_uring or stream
+    std::vector<std::string> peers;      // Cluster peers (host:port) to run anti-entropy against
+    int anti_entropy_interval_ms = 5000;
+    QosOptions qos;
+};
+
 class FileSyncServiceImpl final : public FileSyncService::Service {
 public:
-    FileSyncServiceImpl(DBManager& db);
+    FileSyncServiceImpl(DBManager& db, const ServerOptions& options = ServerOptions());
     
     grpc::Status UploadFile(grpc::ServerContext* context, grpc::ServerReader<FileChunk>* reader, UploadResponse* response) override;
     grpc::Status DownloadFile(grpc::ServerContext* context, const FileRequest* request, grpc::ServerWriter<FileChunk>* writer) override;
+    grpc::Status BatchUpload(grpc::ServerContext* context, grpc::ServerReader<BatchFileFrame>* reader, BatchUploadResponse* response) override;
+    grpc::Status BatchDownload(grpc::ServerContext* context, const BatchDownloadRequest* request, grpc::ServerWriter<BatchFileFrame>* writer) override;
+    grpc::Status GetFileInfo(grpc::ServerContext* context, const FileRequest* request, FileInfo* response) override;
     grpc::Status ListFiles(grpc::ServerContext* context, const ListFilesRequest* request, FileListResponse* response) override;
+    grpc::Status GetStats(grpc::ServerContext* context, const StatsRequest* request, StatsResponse* response) override;
+    grpc::Status GetTrace(grpc::ServerContext* context, const TraceRequest* request, TraceResponse* response) override;
+
+    // Cluster replication hooks
+    const MerkleTree& merkle() const { return merkle_; }
+    // True if `file` wins last-writer-wins against the local version (or there is none)
+    bool SupersedesLocal(const FileRecord& file);
+    // Store a file version pulled from a peer and publish it with the peer's
+    // metadata, unless the content does not match or a newer local version won
+    // meanwhile. `read_chunk` returns false at the end of the stream.
+    bool StoreReplica(const FileRecord& file, const std::function<bool(std::string&)>& read_chunk);
+
+    // CRDT import/export hooks
+    // Metadata of the current version of a file; false if it is unknown
+    bool GetFileRecord(const std::string& file_name, FileRecord& file);
+    // Read the current version of a file; false if it is unknown, larger than
+    // `max_size`, or the stored bytes do not match its metadata
+    bool ReadFile(const std::string& file_name, int64_t max_size, FileRecord& file, std::string& data);
+    // Store `data` as a new version of file_name that wins over the current one
+    bool StoreFile(const std::string& file_name, const std::string& data, FileRecord& file);
+
+    // Shared with the CRDT service so edits and transfers are scheduled together
+    QosScheduler& qos() { return qos_; }
 
 private:
+    // Record a new file version in the DB and drop cached chunks of the version it replaces
+    bool PublishFile(const std::string& file_name, const std::string& hash, int64_t size, int64_t timestamp);
+    bool PublishFileLocked(const std::string& file_name, const std::string& hash, int64_t size, int64_t timestamp);
+    // Same for a batch, with all metadata written in one transaction; requires publish_mutex_
+    bool PublishFilesLocked(const std::vector<FileRecord>& files);
+
+    // A synced copy written under `name + suffix` in primary (and maybe backup) storage
+    struct StagedFile {
+        FileRecord record;
+        bool has_backup = false;
+        bool installed = false; // Set once renamed into place and published
+    };
+    // Rename staged copies over the live ones and publish their metadata in one
+    // transaction; requires publish_mutex_. The replaced copies are kept until the
+    // metadata is written and restored if that fails, so disk and metadata never
+    // disagree. Files that cannot be moved are skipped; returns false only if the
+    // metadata write failed, in which case nothing was installed.
+    bool InstallStagedLocked(std::vector<StagedFile>& files, const std::string& suffix);
+    // Open a stored file for reading, failing over from primary to backup
+    std::unique_ptr<StorageFile> OpenStoredFile(const std::string& file_name);
+
     DBManager& db_;
+    ChunkCache chunk_cache_;
+    std::unique_ptr<StorageEngine> storage_;
+    MerkleTree merkle_;
+    QosScheduler qos_;
+    // Keeps the DB and the Merkle tree in step, and replica check-then-publish atomic
+    std::mutex publish_mutex_;
 };
 
 class CRDTServiceImpl final : public CRDTService::Service {
 public:
-    CRDTServiceImpl();
+    // Documents are imported from and exported to the files served by `files`
+    explicit CRDTServiceImpl(FileSyncServiceImpl& files);
     grpc::Status ApplyCRDTUpdate(grpc::ServerContext* context, const CRDTOperation* request, CRDTResponse* response) override;
     grpc::Status GetCRDTState(grpc::ServerContext* context, const CRDTStateRequest* request, CRDTStateResponse* response) override;
+    grpc::Status ImportFile(grpc::ServerContext* context, const CRDTImportRequest* request, CRDTImportResponse* response) override;
+    grpc::Status ExportFile(grpc::ServerContext* context, const CRDTExportRequest* request, CRDTExportResponse* response) override;
 
 private:
+    FileSyncServiceImpl& files_;
     CRDTManager crdt_manager_;
 };
 
-void RunServer(const std::string& server_address, const std::string& db_path);
+// Owns the DB, the services and the gRPC server. Used by RunServer and by the
+// in-process load generator in filesync_bench.
+class FileSyncServer {
+public:
+    FileSyncServer(const std::string& server_address, const std::string& db_path, const ServerOptions& options = ServerOptions());
+    ~FileSyncServer();
+
+    // Returns false if the DB cannot be opened or the address cannot be bound
+    bool Start();
+    void Wait();
+    void Shutdown();
+
+    // Actual port, useful when listening on port 0
+    int port() const { return selected_port_; }
+
+private:
+    std::string server_address_;
+    ServerOptions options_;
+    DBManager db_;
+    std::unique_ptr<FileSyncServiceImpl> service_;
+    std::unique_ptr<CRDTServiceImpl> crdt_service_;
+    std::unique_ptr<ClusterServiceImpl> cluster_service_;
+    std::unique_ptr<AntiEntropy> anti_entropy_;
+    std::unique_ptr<grpc::Server> server_;
+    int selected_port_ = 0;
+};
+
+void RunServer(const std::string& server_address, const std::string& db_path, const ServerOptions& options = ServerOptions());
 
 } // namespace filesync
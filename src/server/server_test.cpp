@@ -0,0 +1,178 @@
+#include "server.h"
+// Upload and range download tests against an in-process server
+#include <grpcpp/grpcpp.h>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include "../common/logger.h"
+#include "../common/utils.h"
+
+namespace filesync {
+
+namespace {
+
+const size_t kChunkSize = 1024 * 1024;
+
+std::string Sha256(const std::string& data) {
+    utils::SHA256Hasher hasher;
+    hasher.Update(data.data(), data.size());
+    return hasher.HexDigest();
+}
+
+bool Upload(FileSyncService::Stub& stub, const std::string& file_name, const std::string& data) {
+    grpc::ClientContext context;
+    UploadResponse response;
+    auto writer = stub.UploadFile(&context, &response);
+    size_t offset = 0;
+    int32_t chunk_index = 0;
+    do {
+        size_t length = std::min(kChunkSize, data.size() - offset);
+        FileChunk chunk;
+        chunk.set_file_name(file_name);
+        chunk.set_chunk_index(chunk_index++);
+        chunk.set_data(data.data() + offset, length);
+        chunk.set_total_size(data.size());
+        offset += length;
+        chunk.set_is_last_chunk(offset == data.size());
+        if (!writer->Write(chunk)) break;
+    } while (offset < data.size());
+    writer->WritesDone();
+    return writer->Finish().ok() && response.success();
+}
+
+struct RangeResult {
+    grpc::Status status;
+    std::string data;
+    std::string range_hash;
+    int chunks = 0;
+    bool last_chunk = false;
+    bool contiguous = true; // Each chunk starts where the previous one ended
+};
+
+RangeResult Download(FileSyncService::Stub& stub, const std::string& file_name, int64_t offset, int64_t length,
+                     const std::string& expected_hash = "") {
+    grpc::ClientContext context;
+    FileRequest request;
+    request.set_file_name(file_name);
+    request.set_offset(offset);
+    request.set_length(length);
+    request.set_expected_hash(expected_hash);
+    auto reader = stub.DownloadFile(&context, request);
+
+    RangeResult result;
+    FileChunk chunk;
+    while (reader->Read(&chunk)) {
+        if (chunk.offset() != offset + static_cast<int64_t>(result.data.size())) result.contiguous = false;
+        result.data += chunk.data();
+        result.chunks++;
+        result.last_chunk = chunk.is_last_chunk();
+        if (chunk.is_last_chunk()) result.range_hash = chunk.range_hash();
+    }
+    result.status = reader->Finish();
+    return result;
+}
+
+bool Check(bool ok, const std::string& what) {
+    if (!ok) std::cerr << "server: " << what << std::endl;
+    return ok;
+}
+
+bool TestRanges(FileSyncService::Stub& stub) {
+    std::mt19937 rng(31);
+    std::string data(2 * kChunkSize + kChunkSize / 2, '\0');
+    for (auto& byte : data) byte = static_cast<char>(rng());
+    if (!Check(Upload(stub, "data.bin", data), "upload failed")) return false;
+    int64_t size = static_cast<int64_t>(data.size());
+
+    bool ok = true;
+    RangeResult full = Download(stub, "data.bin", 0, 0);
+    ok = Check(full.status.ok() && full.data == data && full.chunks == 3 && full.contiguous, "full download differs") && ok;
+
+    // Across a chunk boundary
+    RangeResult middle = Download(stub, "data.bin", kChunkSize - 100, 300);
+    ok = Check(middle.status.ok() && middle.data == data.substr(kChunkSize - 100, 300) && middle.chunks == 2 && middle.contiguous &&
+               middle.range_hash == Sha256(middle.data), "middle range differs") && ok;
+
+    RangeResult tail = Download(stub, "data.bin", size - 10, 0);
+    ok = Check(tail.status.ok() && tail.data == data.substr(size - 10) && tail.range_hash == Sha256(tail.data),
+               "tail range differs") && ok;
+
+    RangeResult clipped = Download(stub, "data.bin", size - 10, 100);
+    ok = Check(clipped.status.ok() && clipped.data == data.substr(size - 10), "range past the end not clipped") && ok;
+
+    RangeResult at_end = Download(stub, "data.bin", size, 0);
+    ok = Check(at_end.status.ok() && at_end.data.empty() && at_end.chunks == 1 && at_end.last_chunk &&
+               at_end.range_hash == Sha256(""), "empty range at the end of the file") && ok;
+
+    RangeResult past_end = Download(stub, "data.bin", size + 1, 0);
+    ok = Check(past_end.status.error_code() == grpc::StatusCode::OUT_OF_RANGE, "offset past the end accepted") && ok;
+    RangeResult negative = Download(stub, "data.bin", -1, 0);
+    ok = Check(negative.status.error_code() == grpc::StatusCode::INVALID_ARGUMENT, "negative offset accepted") && ok;
+    RangeResult stale = Download(stub, "data.bin", 0, 10, Sha256("other"));
+    ok = Check(stale.status.error_code() == grpc::StatusCode::FAILED_PRECONDITION, "stale expected_hash accepted") && ok;
+    RangeResult missing = Download(stub, "missing.bin", 0, 0);
+    ok = Check(missing.status.error_code() == grpc::StatusCode::NOT_FOUND, "missing file served") && ok;
+    return ok;
+}
+
+bool TestOverwrite(FileSyncService::Stub& stub) {
+    bool ok = Check(Upload(stub, "empty.txt", ""), "empty upload failed");
+    RangeResult empty = Download(stub, "empty.txt", 0, 0);
+    ok = Check(empty.status.ok() && empty.data.empty() && empty.last_chunk, "empty file download") && ok;
+
+    // A shorter version replaces the cached chunks of the old one
+    std::string first(kChunkSize + 10, 'a');
+    std::string second = "second version";
+    ok = Check(Upload(stub, "doc.txt", first) && Download(stub, "doc.txt", 0, 0).data == first, "first version") && ok;
+    ok = Check(Upload(stub, "doc.txt", second) && Download(stub, "doc.txt", 0, 0).data == second, "second version") && ok;
+
+    for (const auto& entry : std::filesystem::directory_iterator("storage/primary")) {
+        std::string name = entry.path().filename().string();
+        ok = Check(name.find(".filesync-") == std::string::npos, "staging file left behind: " + name) && ok;
+    }
+    return ok;
+}
+
+// Names that would escape the storage directories are refused
+bool TestFileNames(FileSyncService::Stub& stub) {
+    bool ok = true;
+    for (const std::string name : {"../escape.txt", "dir/file.txt", ".."}) {
+        ok = Check(!Upload(stub, name, "data"), "upload accepted invalid name " + name) && ok;
+    }
+    ok = Check(!std::filesystem::exists("storage/escape.txt"), "upload escaped storage/primary") && ok;
+    return ok;
+}
+
+} // namespace
+
+} // namespace filesync
+
+int main() {
+    auto work_dir = std::filesystem::temp_directory_path() / ("filesync_server_test_" + std::to_string(getpid()));
+    std::filesystem::create_directories(work_dir / "storage" / "primary");
+    std::filesystem::create_directories(work_dir / "storage" / "backup");
+    std::filesystem::current_path(work_dir);
+    filesync::Logger::Instance().SetLevel(filesync::LogLevel::Warning);
+
+    bool ok = false;
+    {
+        filesync::FileSyncServer server("127.0.0.1:0", "server_test.db");
+        if (server.Start()) {
+            auto channel = grpc::CreateChannel("127.0.0.1:" + std::to_string(server.port()), grpc::InsecureChannelCredentials());
+            auto stub = filesync::FileSyncService::NewStub(channel);
+            ok = filesync::TestRanges(*stub);
+            ok = filesync::TestOverwrite(*stub) && ok;
+            ok = filesync::TestFileNames(*stub) && ok;
+        } else {
+            std::cerr << "server_test: failed to start the server" << std::endl;
+        }
+    }
+
+    std::filesystem::current_path(std::filesystem::temp_directory_path());
+    std::filesystem::remove_all(work_dir);
+    std::cout << (ok ? "server_test: OK" : "server_test: FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include "storage_engine.h"
+// Storage engine selection and std::fstream backend
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include "../common/logger.h"
+
+namespace filesync {
+
+namespace {
+
+class StreamStorageFile : public StorageFile {
+public:
+    explicit StreamStorageFile(const std::string& path) : path_(path) {}
+
+    int64_t ReadAt(int64_t offset, char* buffer, size_t length) override {
+        if (!in_.is_open()) return -1;
+        in_.clear();
+        in_.seekg(offset);
+        in_.read(buffer, length);
+        if (in_.bad()) return -1;
+        return in_.gcount();
+    }
+
+    std::string path_;
+    std::ifstream in_;
+    std::ofstream out_;
+};
+
+class StreamStorageEngine : public StorageEngine {
+public:
+    const char* Name() const override { return "stream"; }
+
+    std::unique_ptr<StorageFile> OpenForRead(const std::string& path) override {
+        auto file = std::make_unique<StreamStorageFile>(path);
+        file->in_.open(path, std::ios::binary);
+        if (!file->in_.is_open()) return nullptr;
+        return file;
+    }
+
+    std::unique_ptr<StorageFile> OpenForWrite(const std::string& path) override {
+        auto file = std::make_unique<StreamStorageFile>(path);
+        file->out_.open(path, std::ios::binary);
+        if (!file->out_.is_open()) return nullptr;
+        return file;
+    }
+
+    std::vector<bool> AppendAll(const std::vector<StorageFile*>& files, const char* data, size_t length) override {
+        std::vector<bool> results;
+        for (StorageFile* base : files) {
+            auto* file = static_cast<StreamStorageFile*>(base);
+            file->out_.write(data, length);
+            results.push_back(file->out_.good());
+        }
+        return results;
+    }
+
+    std::vector<bool> SyncAll(const std::vector<StorageFile*>& files) override {
+        std::vector<bool> results;
+        for (StorageFile* base : files) {
+            auto* file = static_cast<StreamStorageFile*>(base);
+            file->out_.flush();
+            // ofstream does not expose its fd; fdatasync through a second descriptor
+            // flushes the same inode.
+            int fd = ::open(file->path_.c_str(), O_RDONLY | O_CLOEXEC);
+            bool ok = file->out_.good() && fd >= 0 && ::fdatasync(fd) == 0;
+            if (fd >= 0) ::close(fd);
+            results.push_back(ok);
+        }
+        return results;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<StorageEngine> CreateStreamStorageEngine() {
+    return std::make_unique<StreamStorageEngine>();
+}
+
+std::unique_ptr<StorageEngine> CreateStorageEngine(const std::string& kind) {
+    if (kind == "stream") {
+        return CreateStreamStorageEngine();
+    }
+    if (kind != "auto" && kind != "io_uring") {
+        FILESYNC_LOG(Warning) << "Unknown storage engine '" << kind << "', using stream";
+        return CreateStreamStorageEngine();
+    }
+
+    auto engine = CreateIoUringStorageEngine();
+    if (!engine) {
+        FILESYNC_LOG(Warning) << "io_uring unavailable, falling back to stream storage engine";
+        return CreateStreamStorageEngine();
+    }
+    return engine;
+}
+
+} // namespace filesync
@@ -0,0 +1,50 @@
+#pragma once
+// Storage engine header
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace filesync {
+
+// An open file in server storage. Files are only valid with the engine that opened them.
+class StorageFile {
+public:
+    virtual ~StorageFile() = default;
+
+    // Positional read. Returns bytes read (0 at EOF) or -1 on error.
+    virtual int64_t ReadAt(int64_t offset, char* buffer, size_t length) = 0;
+};
+
+// Blob I/O used by FileSyncServiceImpl for the primary and backup copies.
+class StorageEngine {
+public:
+    virtual ~StorageEngine() = default;
+
+    virtual const char* Name() const = 0;
+
+    // Returns nullptr if the file cannot be opened.
+    virtual std::unique_ptr<StorageFile> OpenForRead(const std::string& path) = 0;
+    // Creates or truncates the file. Returns nullptr if it cannot be opened.
+    virtual std::unique_ptr<StorageFile> OpenForWrite(const std::string& path) = 0;
+
+    // Append the same bytes to every file in one batch (e.g. primary + backup).
+    // Returns per-file success, in the order of `files`.
+    virtual std::vector<bool> AppendAll(const std::vector<StorageFile*>& files, const char* data, size_t length) = 0;
+
+    // Durability point: fdatasync every file in one batch. Returns per-file success.
+    virtual std::vector<bool> SyncAll(const std::vector<StorageFile*>& files) = 0;
+};
+
+// kind is "auto", "io_uring" or "stream". "auto" (and "io_uring") fall back to
+// the stream engine when io_uring is unavailable on this kernel.
+std::unique_ptr<StorageEngine> CreateStorageEngine(const std::string& kind);
+
+// Blocking std::fstream backend
+std::unique_ptr<StorageEngine> CreateStreamStorageEngine();
+
+// Returns nullptr if io_uring is not supported here
+std::unique_ptr<StorageEngine> CreateIoUringStorageEngine();
+
+} // namespace filesync